@@ -25,14 +25,34 @@
 #ifndef CI_HMM_R_HPP
 #define CI_HMM_R_HPP
 
+#include "impl/batch.hpp"
+#include "impl/beam.hpp"
 #include "impl/bkd.hpp"
 #include "impl/efun.hpp"
 #include "impl/evalp.hpp"
+#include "impl/fixed.hpp"
 #include "impl/fwd.hpp"
 #include "impl/gamma.hpp"
 #include "impl/infinity.hpp"
+#include "impl/logsum.hpp"
+#include "impl/mask.hpp"
+#include "impl/online.hpp"
+#include "impl/packed.hpp"
+#include "impl/perf.hpp"
+#include "impl/plan.hpp"
+#include "impl/quant.hpp"
+#include "impl/reduce.hpp"
+#include "impl/scan.hpp"
+#include "impl/serve.hpp"
+#include "impl/sparse.hpp"
+#include "impl/split.hpp"
+#include "impl/stats.hpp"
+#include "impl/step.hpp"
 #include "impl/train.hpp"
+#include "impl/trellis.hpp"
 #include "impl/viterbi.hpp"
+#include "impl/workspace.hpp"
+#include "impl/writer.hpp"
 #include "impl/xi.hpp"
 
 
@@ -28,9 +28,12 @@
 
 #include <algorithm>
 #include <cmath>
-#include <list>
+#include <thread>
 #include <vector>
 
+#include "bkd.hpp"
+#include "logsum.hpp"
+#include "workspace.hpp"
 
 namespace ci {
 
@@ -54,36 +57,48 @@ namespace details {
   //
   //     Try to keep some reasonable number of items in memory at any given
   //       time without needing to traverse all observations more than twice.
-  template <typename O, typename I, typename T, typename E, typename U>
+  //
+  //     Columns handed out by Next() come from a Workspace<>'s pool when one
+  //       is given; hand them back with Release().  Otherwise, they are
+  //       plain heap allocations and the user must delete them.
+  //
+  //     Segments after the first are recomputed on a helper thread, one
+  //       segment ahead of the consumer, so the second backward traversal
+  //       overlaps the caller's forward work.  The helper has its own
+  //       scratch space; the columns are the same as a serial recompute.
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   struct BackCache {
 
     //=============
     // Constructor
-    BackCache(const O& o, const I& i, const T& t, const E& e)
+    BackCache(const O& o, const I& i, const T& t, const E& e, L lsum = L(),
+              Workspace<U>* ws = 0)
                            : initialize_(true),
                              sz_(std::max(static_cast<std::size_t>(10000),
                                           static_cast<std::size_t>(std::sqrt(o.size())))),
                              observed_(o), initial_(i),
-                             transition_(t), emission_(e)
+                             transition_(t), emission_(e), lsum_(lsum),
+                             ws_(ws ? ws : &own_), pool_(ws ? &ws->pool : 0)
       {  populate(); } // do full backward traversal
 
     //============
     // Destructor
     ~BackCache() {
-      typedef typename std::list< std::vector<U>* >::iterator CType;
-      for ( CType c = passiveItems_.begin(); c != passiveItems_.end(); ++c )
-        delete *c;
-      for ( CType c = activeItems_.begin(); c != activeItems_.end(); ++c )
-        delete *c;
+      settle();
+      for ( std::size_t c = 0; c < passiveItems_.size(); ++c )
+        Release(passiveItems_[c]);
+      for ( std::size_t c = 0; c < activeItems_.size(); ++c )
+        Release(activeItems_[c]);
     }
 
     //=========
     // Next()
-    //  : User must manage memory obtained
+    //  : User must manage memory obtained; see Release()
     inline std::vector<U> const* Next() {
       if ( !activeItems_.empty() ) {
-        std::vector<U>* rtn = activeItems_.front();
-        activeItems_.pop_front();
+        std::vector<U>* rtn = activeItems_.back();
+        activeItems_.pop_back();
         return(rtn);
       }
 
@@ -93,6 +108,17 @@ namespace details {
       return(Next());
     }
 
+    //===========
+    // Release()
+    //  : Give back a column obtained from Next()
+    inline void Release(std::vector<U> const* v) {
+      std::vector<U>* p = const_cast< std::vector<U>* >(v);
+      if ( pool_ )
+        pool_->Put(p);
+      else
+        delete p;
+    }
+
     //========
     // Size()
     std::size_t Size() const
@@ -104,31 +130,67 @@ namespace details {
               : markers_(b.markers_), counters_(b.counters_),
                 initialize_(b.initialize_), sz_(b.sz_), observed_(b.observed_),
                 initial_(b.initial_), transition_(b.transition_),
-                emission_(b.emission_) {
+                emission_(b.emission_), lsum_(b.lsum_),
+                ws_(b.pool_ ? b.ws_ : &own_), pool_(b.pool_) {
+      // b's helper only reads its passive columns; anything it has
+      //  prefetched stays with b, and this copy recomputes on demand
 
-      typedef typename std::list< std::vector<U>* >::const_iterator CType;
-      for ( CType c = b.passiveItems_.begin(); c != b.passiveItems_.end(); ++c )
-        passiveItems_.push_back(new std::vector<U>(**c));
-      for ( CType c = b.activeItems_.begin(); c != b.activeItems_.end(); ++c )
-        activeItems_.push_back(new std::vector<U>(**c));
+      for ( std::size_t c = 0; c < b.passiveItems_.size(); ++c )
+        passiveItems_.push_back(make(*b.passiveItems_[c]));
+      for ( std::size_t c = 0; c < b.activeItems_.size(); ++c )
+        activeItems_.push_back(make(*b.activeItems_[c]));
     }
 
     //===============
     // No Assignment
     void operator=(const BackCache& b); // disabled purposefully for now
- 
+
   private:
+    // wait for the helper and drop what it computed
+    void settle() {
+      if ( helper_.joinable() )
+        helper_.join();
+      if ( nextItems_.empty() )
+        return;
+      for ( std::size_t c = 1; c < nextItems_.size(); ++c ) // [0] is passiveItems_.back()
+        Release(nextItems_[c]);
+      nextItems_.clear();
+    }
+
+    // recompute the segment behind passiveItems_.back() on the helper thread
+    void prefetch() {
+      if ( passiveItems_.empty() )
+        return;
+      helper_ = std::thread([this]() {
+        std::vector<U>* top = passiveItems_.back();
+        std::vector<U>& beta = scratch_.beta;
+        beta.assign(top->begin(), top->end());
+        nextItems_.push_back(top);
+        const EmitterScope<E> scope(scratch_.emitters, emission_);
+        for ( std::size_t s = markers_.back(), i = counters_.back(); i > 1; --i, --s ) {
+          backward_next(observed_, initial_, transition_, emission_, s, beta, scratch_, lsum_);
+          nextItems_.push_back(make(beta));
+        } // for
+      });
+    }
+
+    inline std::vector<U>* make(const std::vector<U>& v) {
+      if ( pool_ )
+        return(pool_->Get(v));
+      return(new std::vector<U>(v));
+    }
+
+    // Items are stored in reverse: back() is the next one out
     void populate() {
       typedef std::vector<U> V;
 
-      typedef typename std::list< std::vector<U>* >::iterator CType;
-      for ( CType c = activeItems_.begin(); c != activeItems_.end(); ++c )
-        delete *c;
+      for ( std::size_t c = 0; c < activeItems_.size(); ++c )
+        Release(activeItems_[c]);
 
       activeItems_.clear();
       if ( sz_ <= 1 || observed_.empty() ) {
-        for ( CType c = passiveItems_.begin(); c != passiveItems_.end(); ++c )
-          delete *c;
+        for ( std::size_t c = 0; c < passiveItems_.size(); ++c )
+          Release(passiveItems_[c]);
         passiveItems_.clear();
         return;
       }
@@ -138,58 +200,62 @@ namespace details {
         V beta(initial_.size(), 0);
         bool lastleg = (observed_.size() <= sz_);
         if ( !lastleg ) {
-          passiveItems_.push_front(new V(beta));
-          markers_.push_front(observed_.size());
-          counters_.push_front(sz_);
+          passiveItems_.push_back(make(beta));
+          markers_.push_back(observed_.size());
+          counters_.push_back(sz_);
         }
 
         for ( std::size_t i = observed_.size()-1, j = 1; i > 0; --i, ++j ) {
           if ( lastleg )
-            activeItems_.push_front(new V(beta));
+            activeItems_.push_back(make(beta));
           else if ( i == sz_ ) {
-            activeItems_.push_front(new V(beta));
-            counters_.pop_front();
-            counters_.push_front(j);
+            activeItems_.push_back(make(beta));
+            counters_.back() = j;
             lastleg = true;
           }
           else if ( j == sz_ ) {
-            passiveItems_.push_front(new V(beta));
-            markers_.push_front(i);
-            counters_.push_front(sz_);
+            passiveItems_.push_back(make(beta));
+            markers_.push_back(i);
+            counters_.push_back(sz_);
             j = 0;
           }
-          backward_next(observed_, initial_, transition_, emission_, i, beta);
+          backward_next(observed_, initial_, transition_, emission_, i, beta, *ws_, lsum_);
         } // for
-        activeItems_.push_front(new V(beta));
+        activeItems_.push_back(make(beta));
+        prefetch();
         return;
       }
       else if ( passiveItems_.empty() ) // nothing left to do
         return;
 
-      // pop off next item from passiveItems_ and re-populate activeItems_
-      V beta = *passiveItems_.front();
-      activeItems_.push_front(passiveItems_.front());
-      passiveItems_.pop_front();
-      std::size_t mark = markers_.front();
-      markers_.pop_front();
-      std::size_t count = counters_.front();
-      counters_.pop_front();
-      for ( std::size_t s = mark, i = count; i > 1; --i, --s ) {
-        backward_next(observed_, initial_, transition_, emission_, s, beta);
-        activeItems_.push_front(new V(beta));
-      } // for
+      // take the helper's segment for passiveItems_.back() and start the next
+      if ( !helper_.joinable() && nextItems_.empty() )
+        prefetch(); // a copy starts without one in flight
+      helper_.join();
+      activeItems_.swap(nextItems_);
+      passiveItems_.pop_back();
+      markers_.pop_back();
+      counters_.pop_back();
+      prefetch();
     }
 
   private:
-    std::list< std::vector<U>* > passiveItems_;
-    std::list< std::vector<U>* > activeItems_;
-    std::list< std::size_t > markers_, counters_;
+    std::vector< std::vector<U>* > passiveItems_;
+    std::vector< std::vector<U>* > activeItems_;
+    std::vector< std::size_t > markers_, counters_;
     bool initialize_;
     const std::size_t sz_;
     const O& observed_;
     const I& initial_;
     const T& transition_;
     const E& emission_;
+    L lsum_;
+    Workspace<U> own_;
+    Workspace<U>* ws_;
+    details::VectorPool<U>* pool_;
+    Workspace<U> scratch_; // helper thread only
+    std::vector< std::vector<U>* > nextItems_; // helper's segment, in activeItems_ order
+    std::thread helper_;
   };
 
 } // namespace details
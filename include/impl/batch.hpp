@@ -0,0 +1,277 @@
+/*
+  FILE: batch.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 17:35:41 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef BATCH_HMM_R_HPP
+#define BATCH_HMM_R_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "efun.hpp"
+#include "infinity.hpp"
+#include "logsum.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    -------------
+    Batch kernels
+    -------------
+    Score or decode many (typically short) sequences against one model,
+      B sequences at a time.  Columns are stored structure-of-arrays,
+      [state][lane], so the innermost loop runs over lanes: every lane
+      applies the same transition entry to a different sequence, which
+      is the shape compilers vectorize.
+
+    Sequences are ragged.  A lane whose sequence ends is refilled with
+      the next waiting sequence on the following step; a lane with
+      nothing left to do is masked (its results are never read).
+
+    Per sequence, the operations and their order match evalp() and
+      viterbi(), so results are identical (evalp_batch() stops short of
+      evalp()'s final exp(), which underflows for all but short inputs).
+  */
+
+namespace details {
+
+  //=============
+  // BatchLanes
+  //   : which sequence each lane holds and how far along it is
+  template <std::size_t B>
+  struct BatchLanes {
+    BatchLanes(std::size_t nsequences) : next_(0), live_(0), n_(nsequences)
+      { seq.fill(nsequences), pos.fill(0); }
+
+    //=========
+    // Load()
+    //  : put the next sequence with at least minlen items in lane b;
+    //      shorter ones are passed to skip(); returns false if none is left
+    template <typename S, typename F>
+    bool Load(std::size_t b, const S& sequences, std::size_t minlen, F skip) {
+      while ( next_ < n_ && sequences[next_].size() < minlen )
+        skip(next_++);
+      if ( next_ == n_ ) {
+        seq[b] = n_;
+        return(false);
+      }
+      seq[b] = next_++, pos[b] = 1, ++live_;
+      return(true);
+    }
+
+    inline bool Active(std::size_t b) const
+      { return(seq[b] != n_); }
+
+    inline void Retire(std::size_t b)
+      { seq[b] = n_, --live_; }
+
+    inline std::size_t Live() const
+      { return(live_); }
+
+    std::array<std::size_t, B> seq, pos;
+
+  private:
+    std::size_t next_, live_;
+    const std::size_t n_;
+  };
+
+  // elnproduct() written as a select so that lane loops vectorize
+  template <typename U>
+  inline U lane_product(U x, U y, U infinite) {
+    return((x == infinite || y == infinite) ? infinite : x + y);
+  }
+
+} // namespace details
+
+  //===============
+  // evalp_batch()
+  //  : logprobs[i] = ln P(sequences[i] | model); evalp() returns its exp()
+  //  : log-zero (inf) for sequences with fewer than 2 observations
+  //  : sequences is a random-access container of observation sequences
+  template <std::size_t B = 8, typename S, typename I, typename T, typename E,
+            typename L = exact_logsum>
+  void evalp_batch(const S& sequences,
+                   const I& initial,
+                   const T& transition,
+                   const E& emission,
+                   std::vector<float>& logprobs,
+                   L lsum = L()) {
+    typedef typename S::value_type::value_type U;
+    const std::size_t nstates = initial.size();
+    const U infinite = inf<U>();
+    logprobs.assign(sequences.size(), inf<float>());
+
+    std::vector<U> alpha(nstates * B, infinite), next(alpha), emis(alpha);
+    details::BatchLanes<B> lanes(sequences.size());
+    auto skip = [](std::size_t) { }; // fewer than 2 observations: left at inf
+
+    auto load = [&](std::size_t b) {
+      if ( !lanes.Load(b, sequences, 2, skip) )
+        return;
+      const std::size_t symbol = static_cast<std::size_t>(sequences[lanes.seq[b]][0]);
+      for ( std::size_t i = 0; i < nstates; ++i )
+        alpha[i*B+b] = elnproduct(initial[i], emission[i][symbol]);
+    };
+
+    for ( std::size_t b = 0; b < B; ++b )
+      load(b);
+
+    while ( lanes.Live() ) {
+      for ( std::size_t b = 0; b < B; ++b ) {
+        if ( !lanes.Active(b) )
+          continue;
+        const std::size_t symbol = static_cast<std::size_t>(sequences[lanes.seq[b]][lanes.pos[b]]);
+        for ( std::size_t j = 0; j < nstates; ++j )
+          emis[j*B+b] = emission[j][symbol];
+      } // for
+
+      for ( std::size_t j = 0; j < nstates; ++j ) {
+        U* const nj = &next[j*B];
+        std::fill(nj, nj + B, infinite);
+        for ( std::size_t k = 0; k < nstates; ++k ) {
+          const U tkj = transition[k][j];
+          const U* const ak = &alpha[k*B];
+          for ( std::size_t b = 0; b < B; ++b )
+            nj[b] = lsum(nj[b], details::lane_product(ak[b], tkj, infinite));
+        } // for
+        const U* const ej = &emis[j*B];
+        for ( std::size_t b = 0; b < B; ++b )
+          nj[b] = details::lane_product(nj[b], ej[b], infinite);
+      } // for
+      alpha.swap(next);
+
+      for ( std::size_t b = 0; b < B; ++b ) {
+        if ( !lanes.Active(b) || ++lanes.pos[b] < sequences[lanes.seq[b]].size() )
+          continue;
+        float enlp = inf<float>();
+        for ( std::size_t i = 0; i < nstates; ++i )
+          enlp = lsum(enlp, alpha[i*B+b]);
+        logprobs[lanes.seq[b]] = enlp;
+        lanes.Retire(b);
+        load(b);
+      } // for
+    } // while
+  }
+
+  //=================
+  // viterbi_batch()
+  //  : paths[i] holds what viterbi(sequences[i], ...) writes
+  template <std::size_t B = 8, typename S, typename I, typename T, typename E>
+  void viterbi_batch(const S& sequences,
+                     const I& initial,
+                     const T& transition,
+                     const E& emission,
+                     std::vector< std::vector<std::size_t> >& paths) {
+    typedef typename S::value_type::value_type U;
+    const std::size_t nstates = initial.size();
+    const U infinite = inf<U>();
+    paths.resize(sequences.size());
+    for ( std::size_t i = 0; i < paths.size(); ++i )
+      paths[i].clear();
+
+    std::vector<U> delta(nstates * B, infinite), next(delta), emis(delta), single(nstates);
+    std::array<U, B> mx, tmp, gmx;
+    std::array<std::size_t, B> index;
+    gmx.fill(0), index.fill(0);
+    details::BatchLanes<B> lanes(sequences.size());
+
+    // first column of sequence s, written to col[i*stride]
+    auto start = [&](std::size_t s, U* col, std::size_t stride) {
+      const std::size_t symbol = static_cast<std::size_t>(sequences[s][0]);
+      std::size_t idx = 0;
+      for ( std::size_t i = 0; i < nstates; ++i ) {
+        col[i*stride] = elnproduct(initial[i], emission[i][symbol]);
+        if ( elngreater(col[i*stride], col[idx*stride]) )
+          idx = i;
+      } // for
+      paths[s].push_back(idx);
+    };
+
+    // a length-1 sequence is done after its first column
+    auto skip = [&](std::size_t s) {
+      if ( sequences[s].size() > 0 )
+        start(s, single.data(), 1);
+    };
+    auto load = [&](std::size_t b) {
+      if ( lanes.Load(b, sequences, 2, skip) )
+        start(lanes.seq[b], &delta[b], B);
+    };
+
+    for ( std::size_t b = 0; b < B; ++b )
+      load(b);
+
+    while ( lanes.Live() ) {
+      for ( std::size_t b = 0; b < B; ++b ) {
+        if ( !lanes.Active(b) )
+          continue;
+        const std::size_t symbol = static_cast<std::size_t>(sequences[lanes.seq[b]][lanes.pos[b]]);
+        for ( std::size_t j = 0; j < nstates; ++j )
+          emis[j*B+b] = emission[j][symbol];
+      } // for
+
+      for ( std::size_t j = 0; j < nstates; ++j ) {
+        const U t0j = transition[0][j];
+        for ( std::size_t b = 0; b < B; ++b )
+          mx[b] = details::lane_product(delta[b], t0j, infinite);
+        for ( std::size_t k = 1; k < nstates; ++k ) {
+          const U tkj = transition[k][j];
+          const U* const dk = &delta[k*B];
+          for ( std::size_t b = 0; b < B; ++b ) {
+            tmp[b] = details::lane_product(dk[b], tkj, infinite);
+            mx[b] = elngreater(tmp[b], mx[b]) ? tmp[b] : mx[b];
+          } // for
+        } // for
+
+        U* const nj = &next[j*B];
+        const U* const ej = &emis[j*B];
+        for ( std::size_t b = 0; b < B; ++b ) {
+          nj[b] = details::lane_product(mx[b], ej[b], infinite);
+          const bool take = (0 == j || elngreater(nj[b], gmx[b]));
+          gmx[b] = take ? nj[b] : gmx[b];
+          index[b] = take ? j : index[b];
+        } // for
+      } // for
+      delta.swap(next);
+
+      for ( std::size_t b = 0; b < B; ++b ) {
+        if ( !lanes.Active(b) )
+          continue;
+        paths[lanes.seq[b]].push_back(index[b]);
+        if ( ++lanes.pos[b] < sequences[lanes.seq[b]].size() )
+          continue;
+        lanes.Retire(b);
+        load(b);
+      } // for
+    } // while
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // BATCH_HMM_R_HPP
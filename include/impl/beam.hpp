@@ -0,0 +1,306 @@
+/*
+  FILE: beam.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 19:12:07 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef BEAM_HMM_R_HPP
+#define BEAM_HMM_R_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "efun.hpp"
+#include "infinity.hpp"
+#include "logsum.hpp"
+#include "step.hpp"
+#include "workspace.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ------------
+    Beam pruning
+    ------------
+    Approximate forward, backward and Viterbi for large state spaces.
+      After each column is computed, states outside the beam are dropped
+      and the next column sums (or maximizes) over the survivors only,
+      so a step costs O(N K) for K active states instead of O(N^2).
+
+    A state survives if it is within width (natural log units) of the
+      column's best state and, when topk is set, among the topk best.
+      Log-zero states never survive.  The last column is never pruned.
+      With the default Beam<>, nothing is dropped and the results match
+      forward_index(), backward_index() and viterbi() exactly.
+
+    BeamStats::dropped sums, over pruned columns, the fraction of each
+      column's mass that was removed.  It is a guide for choosing the
+      beam: a pruned forward pass never overestimates the likelihood, and
+      small dropped mass means little was lost, but it is not a bound.
+  */
+
+  //==========
+  // Beam<>
+  //   : width - keep states within width of the column's best
+  //   : topk  - keep at most topk states per column; 0 means no limit
+  template <typename U>
+  struct Beam {
+    explicit Beam(U w = inf<U>(), std::size_t k = 0) : width(w), topk(k)
+      { }
+
+    inline bool Active() const
+      { return(width != inf<U>() || 0 != topk); }
+
+    U width;
+    std::size_t topk;
+  };
+
+  //============
+  // BeamStats
+  //   : accumulates over every call it is passed to
+  struct BeamStats {
+    BeamStats() : dropped(0), active(0), columns(0)
+      { }
+
+    double dropped; // sum of the fraction of mass pruned from each column
+    std::size_t active; // surviving states, summed over pruned columns
+    std::size_t columns; // number of pruned columns
+  };
+
+namespace details {
+
+  //==============
+  // beam_prune()
+  //  : sets every state outside the beam to log-zero; keep receives the
+  //      survivors in increasing order
+  template <typename U, typename L>
+  void beam_prune(std::vector<U>& col,
+                  const Beam<U>& beam,
+                  std::vector<std::size_t>& keep,
+                  BeamStats& stats,
+                  L lsum) {
+    const U infinite = inf<U>();
+    const std::size_t nstates = col.size();
+    U best = infinite;
+    for ( std::size_t j = 0; j < nstates; ++j ) {
+      if ( col[j] != infinite && (best == infinite || col[j] > best) )
+        best = col[j];
+    } // for
+
+    keep.clear();
+    for ( std::size_t j = 0; j < nstates; ++j ) {
+      if ( col[j] != infinite && (beam.width == infinite || col[j] >= best - beam.width) )
+        keep.push_back(j);
+    } // for
+    if ( 0 != beam.topk && keep.size() > beam.topk ) {
+      std::nth_element(keep.begin(), keep.begin() + beam.topk, keep.end(),
+                       [&col](std::size_t a, std::size_t b) { return(col[a] > col[b] || (col[a] == col[b] && a < b)); });
+      keep.resize(beam.topk);
+      std::sort(keep.begin(), keep.end());
+    }
+
+    U total = infinite, lost = infinite;
+    for ( std::size_t j = 0, k = 0; j < nstates; ++j ) {
+      if ( col[j] == infinite )
+        continue;
+      total = lsum(total, col[j]);
+      if ( k < keep.size() && keep[k] == j )
+        ++k;
+      else
+        lost = lsum(lost, col[j]), col[j] = infinite;
+    } // for
+    if ( lost != infinite )
+      stats.dropped += std::exp(lost - total);
+    stats.active += keep.size();
+    ++stats.columns;
+  }
+
+} // namespace details
+
+  //================
+  // forward_beam()
+  //  - forward_index() propagating only the states inside the beam
+  //  - scratch space comes from ws
+  //================
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void forward_beam(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    std::size_t index,
+                    std::vector<U>& alpha,
+                    const Beam<U>& beam,
+                    BeamStats& stats,
+                    Workspace<U>& ws,
+                    L lsum = L()) {
+    if ( index < 1 )
+      return;
+
+    const std::size_t nstates = initial.size();
+    std::vector<U>* lcl = ws.roll;
+    lcl[0].resize(nstates), lcl[1].resize(nstates);
+    for ( std::size_t i = 0; i < nstates; ++i )
+      lcl[0][i] = elnproduct(initial[i], emission[i][observed[0]]);
+
+    std::vector<std::size_t> keep;
+    const details::LogRing<U, L> ring(lsum);
+    std::size_t active = 0, passive = active + 1;
+    for ( std::size_t s = 1; s < index; ++s ) {
+      details::beam_prune(lcl[active], beam, keep, stats, lsum);
+      details::step_forward(ring, keep, details::Span(nstates), transition,
+                            [&](std::size_t k) { return(lcl[active][k]); },
+                            [&](std::size_t j, U v) { lcl[passive][j] = v; },
+                            [&](std::size_t j) { return(emission[j][observed[s]]); });
+      std::swap(active, passive);
+    } // for
+
+    for ( std::size_t idx = 0; idx < nstates; ++idx )
+      alpha[idx] = lcl[active][idx];
+  }
+
+  //=================
+  // backward_beam()
+  //  - backward_index() propagating only the states inside the beam
+  //  - scratch space comes from ws
+  //=================
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void backward_beam(const O& observed,
+                     const I& initial,
+                     const T& transition,
+                     const E& emission,
+                     std::size_t index,
+                     std::vector<U>& beta,
+                     const Beam<U>& beam,
+                     BeamStats& stats,
+                     Workspace<U>& ws,
+                     L lsum = L()) {
+    std::size_t nobs = observed.size();
+    std::size_t nstates = initial.size();
+    if ( nobs < 2 )
+      return;
+    else if ( index > observed.size() || index < 1 )
+      return;
+
+    std::vector<U>* lcl = ws.roll;
+    lcl[0].assign(nstates, 0), lcl[1].assign(nstates, 0);
+
+    std::vector<std::size_t> keep;
+    const details::LogRing<U, L> ring(lsum);
+    std::size_t active = 0, passive = active + 1;
+    for ( std::size_t s = nobs-1; s >= index; ) {
+      details::beam_prune(lcl[active], beam, keep, stats, lsum);
+      details::step_backward(ring, keep, details::Span(nstates), transition,
+                             [&](std::size_t k) { return(lcl[active][k]); },
+                             [&](std::size_t j, U v) { lcl[passive][j] = v; },
+                             [&](std::size_t k) { return(emission[k][observed[s]]); });
+      std::swap(active, passive);
+      if ( 0 == s-- )
+        break;
+    } // for
+
+    for ( std::size_t idx = 0; idx < nstates; ++idx )
+      beta[idx] = lcl[active][idx];
+  }
+
+  //==============
+  // evalp_beam()
+  //  - evalp() over forward_beam(); never larger than evalp()
+  //==============
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  float evalp_beam(const O& observed,
+                   const I& initial,
+                   const T& transition,
+                   const E& emission,
+                   const Beam<U>& beam,
+                   BeamStats& stats,
+                   Workspace<U>& ws,
+                   L lsum = L()) {
+    std::size_t tsize = observed.size();
+    if ( tsize < 2 )
+      return(inf<float>());
+
+    std::vector<U>& alpha = ws.alphaG;
+    alpha.resize(initial.size());
+    forward_beam(observed, initial, transition, emission, tsize, alpha, beam, stats, ws, lsum);
+    float enlp = inf<float>();
+    for ( std::size_t i = 0; i < alpha.size(); ++i )
+      enlp = lsum(enlp, alpha[i]);
+    return(std::exp(enlp));
+  }
+
+  //================
+  // viterbi_beam()
+  //  - viterbi() maximizing only over the states inside the beam
+  //  - scratch space comes from ws
+  //================
+  template <typename O, typename I, typename T, typename E, typename OutIter, typename U>
+  void viterbi_beam(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    OutIter out,
+                    const Beam<U>& beam,
+                    BeamStats& stats,
+                    Workspace<U>& ws) {
+    const std::size_t nstates = initial.size();
+    const std::size_t nobs = observed.size();
+    std::vector<U>* delta = ws.roll;
+    delta[0].resize(nstates), delta[1].resize(nstates);
+    std::size_t index = 0;
+    for ( std::size_t i = 0; i < nstates; ++i ) {
+      delta[0][i] = elnproduct(initial[i], emission[i][observed[0]]);
+      if ( elngreater(delta[0][i], delta[0][index]) )
+        index = i;
+    } // for
+    *out++ = index;
+
+    std::vector<std::size_t> keep;
+    exact_logsum lsum;
+    U gmx = 0;
+    std::size_t active = 0, passive = active + 1;
+    for ( std::size_t s = 1; s < nobs; ++s ) {
+      details::beam_prune(delta[active], beam, keep, stats, lsum);
+      details::step_forward(details::MaxPlusRing<U>(), keep, details::Span(nstates), transition,
+                            [&](std::size_t k) { return(delta[active][k]); },
+                            [&](std::size_t j, U v) {
+                              delta[passive][j] = v;
+                              if ( 0 == j || elngreater(v, gmx) )
+                                gmx = v, index = j;
+                            },
+                            [&](std::size_t j) { return(emission[j][observed[s]]); });
+      *out++ = index;
+      std::swap(active, passive);
+    } // for
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // BEAM_HMM_R_HPP
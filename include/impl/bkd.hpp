@@ -26,69 +26,121 @@
 #ifndef BKD_HMM_R_HPP
 #define BKD_HMM_R_HPP
 
+#include <algorithm>
 #include <list>
 #include <vector>
 
 #include "efun.hpp"
 #include "infinity.hpp"
+#include "logsum.hpp"
+#include "step.hpp"
+#include "trellis.hpp"
+#include "workspace.hpp"
 
 namespace ci {
 
 namespace hmm {
 
+  /*
+    Sparse emissions
+      When ws.emitters is bound to emission (see EmitterScope<>), the sum
+      for beta at position s-1 runs only over the states that emit
+      observed[s]; the others contribute exactly log-zero.
+  */
+
   //=============================
   // backward_full() algorithm()
   //  - calculates & retains all calculated beta values down to index
+  //  - beta is resized to one row per observation; row s holds beta at
+  //      position s, for s from index-1 on (the last row is 0)
+  //  - binds ws.emitters to emission while it runs
   //=============================
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   void backward_full(const O& observed,
                      const I& initial,
                      const T& transition,
                      const E& emission,
                      std::size_t index,
-                     std::vector< std::vector<U> >& beta) {
+                     Trellis<U>& beta,
+                     Workspace<U>& ws,
+                     L lsum = L()) {
     std::size_t nobs = observed.size();
     std::size_t nstates = initial.size();
-    if ( nobs < 2 )
-      return;
-    else if ( index > observed.size() || index < 1 )
+    if ( index > nobs || index < 1 )
       return;
 
-    for ( std::size_t i = 0; i < nstates; ++i ) {
-      for ( std::size_t j = nobs-1; j >= index; ) {
-        beta[i][j] = 0;
-        if ( 0 == j-- )
-          break;
-      } // for
-    } // for
+    beta.Resize(nobs, nstates);
+    std::fill(beta[nobs-1], beta[nobs-1] + nstates, static_cast<U>(0));
 
-    for ( std::size_t s = nobs-1; s >= index; ) {
-      for ( std::size_t j = 0; j < nstates; ++j ) {
-        U tmpf = inf<U>();
-        for ( std::size_t k = 0; k < nstates; ++k ) {
-          tmpf = elnsum(tmpf,
-                        elnproduct(transition[j][k],
-                                   elnproduct(emission[k][observed[s]],
-                                              beta[k][s])));
-        } // for
-        beta[j][s-1] = tmpf;
-      } // for
-      if ( 0 == s-- )
-        break;
+    const details::EmitterScope<E> scope(ws.emitters, emission);
+    const bool sparse = ws.emitters.Bound(emission);
+    const details::LogRing<U, L> ring(lsum);
+    const details::Span all(nstates);
+    for ( std::size_t s = nobs-1; s >= index; --s ) {
+      const U* const last = beta[s];
+      U* const col = beta[s-1];
+      auto next = [&](std::size_t k) { return(last[k]); };
+      auto prev = [&](std::size_t j, U v) { col[j] = v; };
+      auto emis = [&](std::size_t k) { return(emission[k][observed[s]]); };
+      if ( sparse )
+        details::step_backward(ring, ws.emitters[observed[s]], all, transition, next, prev, emis);
+      else
+        details::step_backward(ring, all, all, transition, next, prev, emis);
     } // for
   }
 
+  //  - [state][time] version: fills beta[i][s] for s from index-1 on in
+  //      arrays sized by the caller, by way of ws.betaT
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void backward_full(const O& observed,
+                     const I& initial,
+                     const T& transition,
+                     const E& emission,
+                     std::size_t index,
+                     std::vector< std::vector<U> >& beta,
+                     Workspace<U>& ws,
+                     L lsum = L()) {
+    const std::size_t nobs = observed.size();
+    if ( nobs < 2 || index > nobs || index < 1 )
+      return;
+
+    backward_full(observed, initial, transition, emission, index, ws.betaT, ws, lsum);
+    for ( std::size_t s = index-1; s < nobs; ++s )
+      for ( std::size_t i = 0; i < beta.size(); ++i )
+        beta[i][s] = ws.betaT[s][i];
+  }
+
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void backward_full(const O& observed,
+                     const I& initial,
+                     const T& transition,
+                     const E& emission,
+                     std::size_t index,
+                     std::vector< std::vector<U> >& beta,
+                     L lsum = L()) {
+    Workspace<U> ws;
+    backward_full(observed, initial, transition, emission, index, beta, ws, lsum);
+  }
+
   //==============================
   // backward_index() algorithm()
   //  - requires minimal memory to calculate beta at a single "time" index
+  //  - scratch space comes from ws; nothing allocated once ws is warm
+  //  - binds ws.emitters to emission while it runs
   //==============================
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   void backward_index(const O& observed,
                       const I& initial,
                       const T& transition,
                       const E& emission,
                       std::size_t index,
-                      std::vector<U>& beta) {
+                      std::vector<U>& beta,
+                      Workspace<U>& ws,
+                      L lsum = L()) {
     std::size_t nobs = observed.size();
     std::size_t nstates = initial.size();
     if ( nobs < 2 )
@@ -96,44 +148,61 @@ namespace hmm {
     else if ( index > observed.size() || index < 1 )
       return;
 
-    std::vector< std::vector<U> > lcl(nstates);
-    for ( std::size_t i = 0; i < nstates; ++i )
-      for ( std::size_t j = 0; j < 2; ++j )
-        lcl[i].resize(2), lcl[i][j] = 0;
+    const details::EmitterScope<E> scope(ws.emitters, emission);
+    const bool sparse = ws.emitters.Bound(emission);
+    std::vector<U>* lcl = ws.roll;
+    lcl[0].assign(nstates, 0), lcl[1].assign(nstates, 0);
 
+    const details::LogRing<U, L> ring(lsum);
+    const details::Span all(nstates);
     std::size_t active = 0, passive = active + 1;
     for ( std::size_t s = nobs-1; s >= index; ) {
-      for ( std::size_t j = 0; j < nstates; ++j ) {
-        U tmpf = inf<U>();
-        for ( std::size_t k = 0; k < nstates; ++k ) {
-          tmpf = elnsum(tmpf,
-                        elnproduct(transition[j][k],
-                                   elnproduct(emission[k][observed[s]],
-                                              lcl[k][active])));
-        } // for
-        lcl[j][passive] = tmpf;
-      } // for
+      auto next = [&](std::size_t k) { return(lcl[active][k]); };
+      auto prev = [&](std::size_t j, U v) { lcl[passive][j] = v; };
+      auto emis = [&](std::size_t k) { return(emission[k][observed[s]]); };
+      if ( sparse )
+        details::step_backward(ring, ws.emitters[observed[s]], all, transition, next, prev, emis);
+      else
+        details::step_backward(ring, all, all, transition, next, prev, emis);
       std::swap(active, passive);
       if ( 0 == s-- )
         break;
     } // for
 
     for ( std::size_t idx = 0; idx < nstates; ++idx )
-      beta[idx] = lcl[idx][active];
+      beta[idx] = lcl[active][idx];
+  }
+
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void backward_index(const O& observed,
+                      const I& initial,
+                      const T& transition,
+                      const E& emission,
+                      std::size_t index,
+                      std::vector<U>& beta,
+                      L lsum = L()) {
+    Workspace<U> ws;
+    backward_index(observed, initial, transition, emission, index, beta, ws, lsum);
   }
 
   //==========================
   // backward_next() algorithm
   //  - calculate next backward_index() given last result
   //     giving much needed memory back to the system if used properly
+  //  - scratch space comes from ws; nothing allocated once ws is warm
+  //  - uses ws.emitters when a caller has bound them to emission
   //==========================
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   void backward_next(const O& observed,
                      const I& initial,
                      const T& transition,
                      const E& emission,
                      std::size_t index,
-                     std::vector<U>& beta) {
+                     std::vector<U>& beta,
+                     Workspace<U>& ws,
+                     L lsum = L()) {
 
     std::size_t nobs = observed.size();
     std::size_t nstates = initial.size();
@@ -147,18 +216,30 @@ namespace hmm {
         beta[i] = 0;
       return;
     }
-    std::vector<U> lcl(beta);
-    U tmpf = inf<U>();
-    for ( std::size_t j = 0; j < nstates; ++j ) {
-      tmpf = inf<U>();
-      for ( std::size_t k = 0; k < nstates; ++k ) {
-        tmpf = elnsum(tmpf,
-                      elnproduct(transition[j][k],
-                                 elnproduct(emission[k][observed[index]],
-                                            lcl[k])));
-      } // for
-      beta[j] = tmpf;
-    } // for
+    std::vector<U>& lcl = ws.last;
+    lcl.assign(beta.begin(), beta.end());
+    const details::LogRing<U, L> ring(lsum);
+    const details::Span all(nstates);
+    auto next = [&](std::size_t k) { return(lcl[k]); };
+    auto prev = [&](std::size_t j, U v) { beta[j] = v; };
+    auto emis = [&](std::size_t k) { return(emission[k][observed[index]]); };
+    if ( ws.emitters.Bound(emission) )
+      details::step_backward(ring, ws.emitters[observed[index]], all, transition, next, prev, emis);
+    else
+      details::step_backward(ring, all, all, transition, next, prev, emis);
+  }
+
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void backward_next(const O& observed,
+                     const I& initial,
+                     const T& transition,
+                     const E& emission,
+                     std::size_t index,
+                     std::vector<U>& beta,
+                     L lsum = L()) {
+    Workspace<U> ws;
+    backward_next(observed, initial, transition, emission, index, beta, ws, lsum);
   }
 
   //===========================
@@ -168,14 +249,19 @@ namespace hmm {
   //     calculations later.  Works when fully-connected model, all
   //     transition probs > 0 and matrix is invertible.  When
   //     this is the case, nothing is better in memory.
+  //  - scratch space comes from ws; nothing allocated once ws is warm
+  //  - keeps every partial sum, so it does not use step_backward()
   //==========================
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   void backward_enext(const O& observed,
                       const I& initial,
                       const T& transition,
                       const E& emission,
                       std::size_t index,
-                      std::vector< std::vector<U> >& beta_internals) {
+                      std::vector< std::vector<U> >& beta_internals,
+                      Workspace<U>& ws,
+                      L lsum = L()) {
 
     const std::size_t nobs = observed.size();
     const std::size_t nstates = initial.size();
@@ -190,20 +276,34 @@ namespace hmm {
       return;
     }
 
-    std::vector<U> lcl(beta_internals[nstates-1].begin(), beta_internals[nstates-1].end());
+    std::vector<U>& lcl = ws.last;
+    lcl.assign(beta_internals[nstates-1].begin(), beta_internals[nstates-1].end());
     U tmpf = inf<U>();
     for ( std::size_t j = 0; j < nstates; ++j ) {
       tmpf = inf<U>();
       for ( std::size_t k = 0; k < nstates; ++k ) {
-        tmpf = elnsum(tmpf,
-                      elnproduct(transition[j][k],
-                                 elnproduct(emission[k][observed[index]],
-                                            lcl[k])));
+        tmpf = lsum(tmpf,
+                    elnproduct(transition[j][k],
+                               elnproduct(emission[k][observed[index]],
+                                          lcl[k])));
         beta_internals[k][j] = tmpf;
       } // for
     } // for
   }
 
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void backward_enext(const O& observed,
+                      const I& initial,
+                      const T& transition,
+                      const E& emission,
+                      std::size_t index,
+                      std::vector< std::vector<U> >& beta_internals,
+                      L lsum = L()) {
+    Workspace<U> ws;
+    backward_enext(observed, initial, transition, emission, index, beta_internals, ws, lsum);
+  }
+
 } // namespace hmm
 
 } // namespace ci
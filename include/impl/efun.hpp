@@ -60,6 +60,31 @@ namespace hmm {
     return(x + y);
   }
 
+  // extended-log-greater: x is more probable than y; log-zero ranks below
+  //   every finite value
+  template <typename T>
+  inline bool elngreater(T x, T y) {
+    static const T infinite = inf<T>();
+    return(x != infinite && (y == infinite || x > y));
+  }
+
+  // extended-exponential
+  template <typename T>
+  inline T eexp(T x) {
+    static const T infinite = inf<T>();
+    if ( x == infinite )
+      return(0);
+    return(std::exp(x));
+  }
+
+  // extended-log
+  template <typename T>
+  inline T eln(T x) {
+    if ( 0 == x )
+      return(inf<T>());
+    return(std::log(x));
+  }
+
 } // namespace hmm
 
 } // namespace ci
@@ -30,6 +30,8 @@
 #include "efun.hpp"
 #include "fwd.hpp"
 #include "infinity.hpp"
+#include "logsum.hpp"
+#include "workspace.hpp"
 
 namespace ci {
 
@@ -38,27 +40,71 @@ namespace hmm {
   //=====================
   // evalp() algorithm
   //   - Wraps hmm::forward() to solve "Problem 1"
+  //   - scratch space comes from ws
   //=====================
-  template <typename O, typename I, typename T, typename E>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   float evalp(const O& observed,
               const I& initial,
               const T& transition,
-              const E& emission) {
+              const E& emission,
+              Workspace<U>& ws,
+              L lsum = L()) {
 
     std::size_t tsize = observed.size();
     if ( tsize < 2 )
       return(inf<float>());
 
     const std::size_t nstates = initial.size();
-    std::vector<float> alpha(nstates);
+    std::vector<U>& alpha = ws.alphaG;
+    alpha.resize(nstates);
 
-    forward_index(observed, initial, transition, emission, tsize, alpha);
+    forward_index(observed, initial, transition, emission, tsize, alpha, ws, lsum);
     float enlp = inf<float>();
     for ( std::size_t i = 0; i < alpha.size(); ++i )
-      enlp = elnsum(enlp, alpha[i]);
+      enlp = lsum(enlp, alpha[i]);
     return(std::exp(enlp));
   }
 
+  template <typename O, typename I, typename T, typename E,
+            typename L = exact_logsum>
+  float evalp(const O& observed,
+              const I& initial,
+              const T& transition,
+              const E& emission,
+              L lsum = L()) {
+    Workspace<float> ws;
+    return(evalp(observed, initial, transition, emission, ws, lsum));
+  }
+
+  //=============
+  // log_evalp()
+  //   - ln P(observed | model); unlike evalp(), it does not underflow
+  //       on long sequences and is defined for one observation
+  //   - log-zero for an empty sequence
+  //   - scratch space comes from ws
+  //=============
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  U log_evalp(const O& observed,
+              const I& initial,
+              const T& transition,
+              const E& emission,
+              Workspace<U>& ws,
+              L lsum = L()) {
+
+    U enlp = inf<U>();
+    if ( observed.empty() )
+      return(enlp);
+
+    std::vector<U>& alpha = ws.alphaG;
+    alpha.resize(initial.size());
+    forward_index(observed, initial, transition, emission, observed.size(), alpha, ws, lsum);
+    for ( std::size_t i = 0; i < alpha.size(); ++i )
+      enlp = lsum(enlp, alpha[i]);
+    return(enlp);
+  }
+
 } // namespace hmm
 
 } // namespace ci
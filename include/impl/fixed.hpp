@@ -0,0 +1,449 @@
+/*
+  FILE: fixed.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 16:42:10 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef FIXED_HMM_R_HPP
+#define FIXED_HMM_R_HPP
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "efun.hpp"
+#include "evalp.hpp"
+#include "infinity.hpp"
+#include "logsum.hpp"
+#include "stats.hpp"
+#include "step.hpp"
+#include "train.hpp"
+#include "viterbi.hpp"
+#include "workspace.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ------------------
+    Fixed-size kernels
+    ------------------
+    Versions of evalp(), viterbi(), estep() and train() for a model whose
+      number of states N is known at compile time.  The model is copied
+      into std::array<> storage (emission symbol-major) and every loop
+      over states has a constant trip count, so the forward, backward,
+      gamma and xi steps unroll completely for small N.
+
+    Each performs the same operations in the same order as its generic
+      counterpart, so results are identical.
+
+    The *_auto() versions take the generic arguments and pick the
+      matching *_fixed<N>() instantiation for MinFixedStates <= N <=
+      MaxFixedStates, falling back on the generic kernel otherwise and
+      for sparse emission rows (sparse.hpp).
+  */
+
+  static constexpr std::size_t MinFixedStates = 2;
+  static constexpr std::size_t MaxFixedStates = 16;
+
+namespace details {
+
+  //===============
+  // FixedModel<>
+  //  : transition is [from][to]; emission is [symbol][state]
+  template <std::size_t N, typename U>
+  struct FixedModel {
+    typedef std::array<U, N> Column;
+
+    template <typename I, typename T, typename E>
+    FixedModel(const I& i, const T& t, const E& e) : emission(e[0].size()) {
+      for ( std::size_t k = 0; k < N; ++k ) {
+        initial[k] = i[k];
+        for ( std::size_t j = 0; j < N; ++j )
+          transition[k][j] = t[k][j];
+        for ( std::size_t m = 0; m < emission.size(); ++m )
+          emission[m][k] = e[k][m];
+      } // for
+    }
+
+    Column initial;
+    std::array<Column, N> transition;
+    std::vector<Column> emission;
+  };
+
+  //=================
+  // forward_step()
+  //  : next = alpha one position on from prev, observing symbol
+  template <std::size_t N, typename U, typename L>
+  inline void forward_step(const FixedModel<N, U>& m, std::size_t symbol,
+                           const U* prev, U* next, L lsum) {
+    const U* emis = m.emission[symbol].data();
+    step_forward(LogRing<U, L>(lsum), FixedSpan<N>(), FixedSpan<N>(), m.transition,
+                 [&](std::size_t k) { return(prev[k]); },
+                 [&](std::size_t j, U v) { next[j] = v; },
+                 [&](std::size_t j) { return(emis[j]); });
+  }
+
+  //=================
+  // backward_step()
+  //  : prev = beta one position before next, which observes symbol
+  template <std::size_t N, typename U, typename L>
+  inline void backward_step(const FixedModel<N, U>& m, std::size_t symbol,
+                            const U* next, U* prev, L lsum) {
+    const U* emis = m.emission[symbol].data();
+    step_backward(LogRing<U, L>(lsum), FixedSpan<N>(), FixedSpan<N>(), m.transition,
+                  [&](std::size_t k) { return(next[k]); },
+                  [&](std::size_t j, U v) { prev[j] = v; },
+                  [&](std::size_t k) { return(emis[k]); });
+  }
+
+  //==============
+  // gamma_step()
+  //  : returns the normalizer, log P(O)
+  template <std::size_t N, typename U, typename L>
+  inline U gamma_step(const U* alpha, const U* beta, U* gam, L lsum) {
+    U normalizer = inf<U>();
+    for ( std::size_t i = 0; i < N; ++i ) {
+      gam[i] = elnproduct(alpha[i], beta[i]);
+      normalizer = lsum(normalizer, gam[i]);
+    } // for
+
+    for ( std::size_t j = 0; j < N; ++j )
+      gam[j] = elnproduct(gam[j], -normalizer);
+    return(normalizer);
+  }
+
+  //===========
+  // xi_step()
+  //  : alpha at one position; beta at the next, which observes symbol
+  template <std::size_t N, typename U, typename L>
+  inline void xi_step(const FixedModel<N, U>& m, std::size_t symbol,
+                      const U* alpha, const U* beta,
+                      std::array<std::array<U, N>, N>& probs, L lxi) {
+    const U* emis = m.emission[symbol].data();
+    U normalizer = inf<U>();
+    for ( std::size_t i = 0; i < N; ++i ) {
+      for ( std::size_t j = 0; j < N; ++j ) {
+        probs[i][j] = elnproduct(alpha[i],
+                                 elnproduct(m.transition[i][j],
+                                            elnproduct(emis[j], beta[j])));
+        normalizer = lxi(normalizer, probs[i][j]);
+      } // for
+    } // for
+
+    for ( std::size_t k = 0; k < N; ++k )
+      for ( std::size_t n = 0; n < N; ++n )
+        probs[k][n] = elnproduct(probs[k][n], -normalizer);
+  }
+
+  template <typename F, std::size_t... Ns>
+  inline bool dispatch_states(std::size_t nstates, F& f, std::index_sequence<Ns...>) {
+    return((false || ... ||
+            (nstates == Ns + MinFixedStates
+               ? (f(std::integral_constant<std::size_t, Ns + MinFixedStates>()), true)
+               : false)));
+  }
+
+} // namespace details
+
+  //===================
+  // dispatch_states()
+  //  : calls f(std::integral_constant<std::size_t, nstates>()) when nstates
+  //      has a fixed-size instantiation; returns false when it does not
+  template <typename F>
+  inline bool dispatch_states(std::size_t nstates, F f) {
+    typedef std::make_index_sequence<MaxFixedStates - MinFixedStates + 1> Ns;
+    return(details::dispatch_states(nstates, f, Ns()));
+  }
+
+  //=================
+  // evalp_fixed()
+  template <std::size_t N, typename O, typename I, typename T, typename E,
+            typename L = exact_logsum>
+  float evalp_fixed(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    L lsum = L()) {
+    typedef typename O::value_type U;
+    const std::size_t nobs = observed.size();
+    if ( nobs < 2 )
+      return(inf<float>());
+
+    const details::FixedModel<N, U> model(initial, transition, emission);
+    std::array<U, N> alpha[2];
+    const U* emis = model.emission[static_cast<std::size_t>(observed[0])].data();
+    for ( std::size_t i = 0; i < N; ++i )
+      alpha[0][i] = elnproduct(model.initial[i], emis[i]);
+
+    std::size_t active = 0, passive = active + 1;
+    for ( std::size_t s = 1; s < nobs; ++s ) {
+      details::forward_step(model, static_cast<std::size_t>(observed[s]),
+                            alpha[active].data(), alpha[passive].data(), lsum);
+      std::swap(active, passive);
+    } // for
+
+    float enlp = inf<float>();
+    for ( std::size_t i = 0; i < N; ++i )
+      enlp = lsum(enlp, alpha[active][i]);
+    return(std::exp(enlp));
+  }
+
+  //=================
+  // viterbi_fixed()
+  //  : same output as viterbi()
+  template <std::size_t N, typename O, typename I, typename T, typename E, typename OutIter>
+  void viterbi_fixed(const O& observed,
+                     const I& initial,
+                     const T& transition,
+                     const E& emission,
+                     OutIter out) {
+    typedef typename O::value_type U;
+    const std::size_t nobs = observed.size();
+    if ( 0 == nobs )
+      return;
+
+    const details::FixedModel<N, U> model(initial, transition, emission);
+    std::array<U, N> delta[2];
+    std::size_t index = 0;
+    const U* emis = model.emission[static_cast<std::size_t>(observed[0])].data();
+    for ( std::size_t i = 0; i < N; ++i ) {
+      delta[0][i] = elnproduct(model.initial[i], emis[i]);
+      if ( elngreater(delta[0][i], delta[0][index]) )
+        index = i;
+    } // for
+
+    *out++ = index;
+    index = 0;
+    U gmx = 0;
+    std::size_t active = 0, passive = active + 1;
+    for ( std::size_t s = 1; s < nobs; ++s ) {
+      emis = model.emission[static_cast<std::size_t>(observed[s])].data();
+      details::step_forward(details::MaxPlusRing<U>(), details::FixedSpan<N>(), details::FixedSpan<N>(), model.transition,
+                            [&](std::size_t k) { return(delta[active][k]); },
+                            [&](std::size_t j, U v) {
+                              delta[passive][j] = v;
+                              if ( 0 == j || elngreater(v, gmx) )
+                                gmx = v, index = j;
+                            },
+                            [&](std::size_t j) { return(emis[j]); });
+      *out++ = index;
+      std::swap(active, passive);
+    } // for
+  }
+
+  //===============
+  // estep_fixed()
+  //  : same statistics as estep()
+  //  : betas are checkpointed at the end of each segment of BackCache<>'s
+  //      length in ws.flat, then recomputed one segment at a time; a helper
+  //      thread recomputes segment g+1 while segment g is consumed
+  template <std::size_t N, typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void estep_fixed(const O& observed,
+                   const I& initial,
+                   const T& transition,
+                   const E& emission,
+                   Statistics<U>& stats,
+                   Workspace<U>& ws,
+                   P = P()) {
+    typedef std::array<U, N> Column;
+    const std::size_t nobs = observed.size();
+    if ( nobs < 2 )
+      return;
+
+    const typename P::forward_type lfwd = typename P::forward_type();
+    const typename P::backward_type lbkd = typename P::backward_type();
+    const typename P::xi_type lxi = typename P::xi_type();
+    const typename P::accumulate_type lacc = typename P::accumulate_type();
+    const details::FixedModel<N, U> model(initial, transition, emission);
+
+    const std::size_t sz = std::max(static_cast<std::size_t>(10000),
+                                    static_cast<std::size_t>(std::sqrt(nobs)));
+    const std::size_t nsegs = (nobs + sz - 1) / sz;
+    ws.flat.resize((nsegs + 2 * sz) * N);
+    U* const marks = ws.flat.data(); // beta at the last position of each segment
+    U* const bufs[2] = { marks + nsegs * N, marks + (nsegs + sz) * N }; // all betas of a segment
+
+    // backward sweep; keep only the checkpoints
+    Column beta[2];
+    beta[0].fill(0);
+    std::size_t active = 0, passive = active + 1;
+    for ( std::size_t s = nobs-1; ; --s ) {
+      if ( s+1 == nobs || s % sz == sz-1 )
+        std::copy(beta[active].begin(), beta[active].end(), marks + (s / sz) * N);
+      if ( 0 == s )
+        break;
+      details::backward_step(model, static_cast<std::size_t>(observed[s]),
+                             beta[active].data(), beta[passive].data(), lbkd);
+      std::swap(active, passive);
+    } // for
+
+    // forward sweep, segment by segment
+    Column alpha[2], gam;
+    std::array<Column, N> probs;
+    std::vector< std::vector<U> >& numeratorT = stats.numeratorT;
+    std::vector<U>& denominator = stats.denominator;
+    active = 0, passive = active + 1;
+    auto recompute = [&](std::size_t g, U* betas) {
+      const std::size_t a = g * sz, b = std::min(a + sz, nobs);
+      std::copy(marks + g * N, marks + (g+1) * N, betas + (b-1-a) * N);
+      for ( std::size_t s = b-1; s > a; --s )
+        details::backward_step(model, static_cast<std::size_t>(observed[s]),
+                               betas + (s-a) * N, betas + (s-1-a) * N, lbkd);
+    };
+
+    std::thread helper;
+    recompute(0, bufs[0]);
+    for ( std::size_t g = 0; g < nsegs; ++g ) {
+      if ( helper.joinable() )
+        helper.join();
+      if ( g+1 < nsegs )
+        helper = std::thread(recompute, g+1, bufs[(g+1) % 2]);
+      const std::size_t a = g * sz, b = std::min(a + sz, nobs);
+      U* const betas = bufs[g % 2];
+
+      for ( std::size_t s = a; s < b; ++s ) {
+        const std::size_t symbol = static_cast<std::size_t>(observed[s]);
+        const U* beta_s = betas + (s-a) * N;
+        if ( 0 == s ) {
+          const U* emis = model.emission[symbol].data();
+          for ( std::size_t i = 0; i < N; ++i )
+            alpha[active][i] = elnproduct(model.initial[i], emis[i]);
+        } else {
+          details::forward_step(model, symbol, alpha[passive].data(), alpha[active].data(), lfwd);
+          details::xi_step(model, symbol, alpha[passive].data(), beta_s, probs, lxi);
+          for ( std::size_t i = 0; i < N; ++i )
+            for ( std::size_t j = 0; j < N; ++j )
+              numeratorT[i][j] = lacc(numeratorT[i][j], probs[i][j]);
+        }
+
+        const U loglik = details::gamma_step<N>(alpha[active].data(), beta_s, gam.data(), lfwd);
+        if ( 0 == s ) {
+          for ( std::size_t y = 0; y < N; ++y )
+            stats.initial[y] = lacc(stats.initial[y], gam[y]);
+          stats.loglik += loglik;
+          ++stats.nsequences;
+        }
+
+        if ( s+1 < nobs ) {
+          std::vector<U>& numE = stats.Symbol(symbol);
+          for ( std::size_t j = 0; j < N; ++j ) {
+            numE[j] = lacc(numE[j], gam[j]);
+            denominator[j] = lacc(denominator[j], gam[j]);
+          } // for
+        }
+        std::swap(active, passive);
+      } // for
+    } // for
+  }
+
+  //===============
+  // train_fixed()
+  //  : estep_fixed() followed by mstep()
+  template <std::size_t N, typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void train_fixed(const O& observed,
+                   I& initial,
+                   T& transition,
+                   E& emission,
+                   Workspace<U>& ws,
+                   P policy = P()) {
+    ws.stats.Reset(initial.size(), emission[0].size());
+    estep_fixed<N>(observed, initial, transition, emission, ws.stats, ws, policy);
+    mstep(ws.stats, initial, transition, emission);
+  }
+
+  //==============
+  // evalp_auto()
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  float evalp_auto(const O& observed,
+                   const I& initial,
+                   const T& transition,
+                   const E& emission,
+                   Workspace<U>& ws,
+                   L lsum = L()) {
+    float rtn = 0;
+    auto f = [&](auto n) { rtn = evalp_fixed<decltype(n)::value>(observed, initial, transition, emission, lsum); };
+    if ( details::sparse_rows<E>::value || !dispatch_states(initial.size(), f) )
+      rtn = evalp(observed, initial, transition, emission, ws, lsum);
+    return(rtn);
+  }
+
+  //================
+  // viterbi_auto()
+  //  : models with log-zero emissions go to viterbi(), which skips states
+  //      that cannot emit a symbol where viterbi_fixed() computes them all
+  template <typename O, typename I, typename T, typename E, typename OutIter, typename U>
+  void viterbi_auto(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    OutIter out,
+                    Workspace<U>& ws) {
+    auto f = [&](auto n) { viterbi_fixed<decltype(n)::value>(observed, initial, transition, emission, out); };
+    if ( details::sparse_rows<E>::value || details::log_zeros(emission) || !dispatch_states(initial.size(), f) )
+      viterbi(observed, initial, transition, emission, out, ws);
+  }
+
+  //==============
+  // estep_auto()
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void estep_auto(const O& observed,
+                  const I& initial,
+                  const T& transition,
+                  const E& emission,
+                  Statistics<U>& stats,
+                  Workspace<U>& ws,
+                  P policy = P()) {
+    auto f = [&](auto n) { estep_fixed<decltype(n)::value>(observed, initial, transition, emission, stats, ws, policy); };
+    if ( details::sparse_rows<E>::value || !dispatch_states(initial.size(), f) )
+      estep(observed, initial, transition, emission, stats, ws, policy);
+  }
+
+  //==============
+  // train_auto()
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void train_auto(const O& observed,
+                  I& initial,
+                  T& transition,
+                  E& emission,
+                  Workspace<U>& ws,
+                  P policy = P()) {
+    ws.stats.Reset(initial.size(), emission[0].size());
+    estep_auto(observed, initial, transition, emission, ws.stats, ws, policy);
+    mstep(ws.stats, initial, transition, emission);
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // FIXED_HMM_R_HPP
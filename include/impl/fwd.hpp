@@ -25,93 +25,178 @@
 #ifndef FWD_HMM_R_HPP
 #define FWD_HMM_R_HPP
 
+#include <algorithm>
 #include <vector>
 
 #include "efun.hpp"
 #include "infinity.hpp"
+#include "logsum.hpp"
+#include "step.hpp"
+#include "trellis.hpp"
+#include "workspace.hpp"
 
 namespace ci {
 
 namespace hmm {
 
+  /*
+    Sparse emissions
+      When ws.emitters is bound to emission (see EmitterScope<>), alpha at
+      position s is log-zero outside the states that emit observed[s], so
+      the forward kernels sum over those predecessors only and compute
+      only those successors.  Skipped terms are exactly log-zero, so the
+      results are unchanged.
+  */
+
   //==========================
   // forward_full() algorithm
   //  - calculates & retains all calculated alpha values up to index
+  //  - alpha is resized to index rows; row s holds alpha at position s
+  //  - binds ws.emitters to emission while it runs
   //==========================
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   void forward_full(const O& observed,
                     const I& initial,
                     const T& transition,
                     const E& emission,
                     std::size_t index,
-                    std::vector< std::vector<U> >& alpha) {
+                    Trellis<U>& alpha,
+                    Workspace<U>& ws,
+                    L lsum = L()) {
     if ( index < 1 )
       return;
 
+    const details::EmitterScope<E> scope(ws.emitters, emission);
+    const bool sparse = ws.emitters.Bound(emission);
     const std::size_t nstates = initial.size();
+    alpha.Resize(index, nstates);
     for ( std::size_t i = 0; i < nstates; ++i )
-      alpha[i][0] = elnproduct(initial[i], emission[i][observed[0]]);
+      alpha[0][i] = elnproduct(initial[i], emission[i][observed[0]]);
 
-    U tmpf = inf<U>();
+    const details::LogRing<U, L> ring(lsum);
+    const details::Span all(nstates);
     for ( std::size_t s = 1; s < index; ++s ) {
-      for ( std::size_t j = 0; j < nstates; ++j ) {
-        tmpf = inf<U>();
-        for ( std::size_t k = 0; k < nstates; ++k )
-          tmpf = elnsum(tmpf, elnproduct(alpha[k][(s-1)], transition[k][j]));
-        alpha[j][s] = elnproduct(tmpf, emission[j][observed[s]]);
-      } // for
+      const U* const last = alpha[s-1];
+      U* const col = alpha[s];
+      auto prev = [&](std::size_t k) { return(last[k]); };
+      auto next = [&](std::size_t j, U v) { col[j] = v; };
+      auto emis = [&](std::size_t j) { return(emission[j][observed[s]]); };
+      if ( sparse ) {
+        std::fill(col, col + nstates, inf<U>());
+        details::step_forward(ring, ws.emitters[observed[s-1]], ws.emitters[observed[s]], transition, prev, next, emis);
+      } else
+        details::step_forward(ring, all, all, transition, prev, next, emis);
     } // for
   }
 
+  //  - [state][time] version: fills alpha[i][s] for s < index in arrays
+  //      sized by the caller, by way of ws.alphaT
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void forward_full(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    std::size_t index,
+                    std::vector< std::vector<U> >& alpha,
+                    Workspace<U>& ws,
+                    L lsum = L()) {
+    forward_full(observed, initial, transition, emission, index, ws.alphaT, ws, lsum);
+    for ( std::size_t s = 0; s < index; ++s )
+      for ( std::size_t i = 0; i < alpha.size(); ++i )
+        alpha[i][s] = ws.alphaT[s][i];
+  }
+
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void forward_full(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    std::size_t index,
+                    std::vector< std::vector<U> >& alpha,
+                    L lsum = L()) {
+    Workspace<U> ws;
+    forward_full(observed, initial, transition, emission, index, alpha, ws, lsum);
+  }
+
   //===========================
   // forward_index() algorithm
   //  - requires minimal memory to calculate alpha at a single "time" index
+  //  - scratch space comes from ws; nothing allocated once ws is warm
+  //  - binds ws.emitters to emission while it runs
   //===========================
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   void forward_index(const O& observed,
                      const I& initial,
                      const T& transition,
                      const E& emission,
                      std::size_t index,
-                     std::vector<U>& alpha) {
+                     std::vector<U>& alpha,
+                     Workspace<U>& ws,
+                     L lsum = L()) {
     if ( index < 1 )
       return;
 
+    const details::EmitterScope<E> scope(ws.emitters, emission);
+    const bool sparse = ws.emitters.Bound(emission);
     const std::size_t nstates = initial.size();
-    std::vector< std::vector<U> > lcl(nstates);
-    for ( std::size_t i = 0; i < nstates; ++i ) {
-      lcl[i].resize(2, 0);
-      lcl[i][0] = elnproduct(initial[i], emission[i][observed[0]]);
-    } // for
+    std::vector<U>* lcl = ws.roll;
+    lcl[0].resize(nstates), lcl[1].resize(nstates);
+    for ( std::size_t i = 0; i < nstates; ++i )
+      lcl[0][i] = elnproduct(initial[i], emission[i][observed[0]]);
 
-    U tmpf = inf<U>();
+    const details::LogRing<U, L> ring(lsum);
+    const details::Span all(nstates);
     std::size_t active = 0, passive = active + 1;
     for ( std::size_t s = 1; s < index; ++s ) {
-      for ( std::size_t j = 0; j < nstates; ++j ) {
-        tmpf = inf<U>();
-        for ( std::size_t k = 0; k < nstates; ++k )
-          tmpf = elnsum(tmpf, elnproduct(lcl[k][active], transition[k][j]));
-        lcl[j][passive] = elnproduct(tmpf, emission[j][observed[s]]);
-      } // for
+      auto prev = [&](std::size_t k) { return(lcl[active][k]); };
+      auto next = [&](std::size_t j, U v) { lcl[passive][j] = v; };
+      auto emis = [&](std::size_t j) { return(emission[j][observed[s]]); };
+      if ( sparse ) {
+        lcl[passive].assign(nstates, inf<U>());
+        details::step_forward(ring, ws.emitters[observed[s-1]], ws.emitters[observed[s]], transition, prev, next, emis);
+      } else
+        details::step_forward(ring, all, all, transition, prev, next, emis);
       std::swap(active, passive);
     } // for
 
     for ( std::size_t idx = 0; idx < nstates; ++idx )
-      alpha[idx] = lcl[idx][active];
+      alpha[idx] = lcl[active][idx];
+  }
+
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void forward_index(const O& observed,
+                     const I& initial,
+                     const T& transition,
+                     const E& emission,
+                     std::size_t index,
+                     std::vector<U>& alpha,
+                     L lsum = L()) {
+    Workspace<U> ws;
+    forward_index(observed, initial, transition, emission, index, alpha, ws, lsum);
   }
 
   //==========================
   // forward_next() algorithm
   //  - calculate next forward_index() given last result
   //     giving much needed memory back to the system if used correctly
+  //  - scratch space comes from ws; nothing allocated once ws is warm
+  //  - uses ws.emitters when a caller has bound them to emission
   //==========================
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   void forward_next(const O& observed,
                     const I& initial,
                     const T& transition,
                     const E& emission,
                     std::size_t index,
-                    std::vector<U>& alpha) {
+                    std::vector<U>& alpha,
+                    Workspace<U>& ws,
+                    L lsum = L()) {
     if ( index < 1 )
       return;
 
@@ -121,15 +206,31 @@ namespace hmm {
         alpha[i] = elnproduct(initial[i], emission[i][observed[0]]);
       return;
     }
-    const std::vector<U> lcl(alpha);
-
-    U tmpf = inf<U>();
-    for ( std::size_t j = 0; j < nstates; ++j ) {
-      tmpf = inf<U>();
-      for ( std::size_t k = 0; k < nstates; ++k )
-        tmpf = elnsum(tmpf, elnproduct(lcl[k], transition[k][j]));
-      alpha[j] = elnproduct(tmpf, emission[j][observed[index-1]]);
-    } // for
+    std::vector<U>& lcl = ws.last;
+    lcl.assign(alpha.begin(), alpha.end());
+
+    const details::LogRing<U, L> ring(lsum);
+    auto prev = [&](std::size_t k) { return(lcl[k]); };
+    auto next = [&](std::size_t j, U v) { alpha[j] = v; };
+    auto emis = [&](std::size_t j) { return(emission[j][observed[index-1]]); };
+    if ( ws.emitters.Bound(emission) ) {
+      std::fill(alpha.begin(), alpha.end(), inf<U>());
+      details::step_forward(ring, ws.emitters[observed[index-2]], ws.emitters[observed[index-1]], transition, prev, next, emis);
+    } else
+      details::step_forward(ring, details::Span(nstates), details::Span(nstates), transition, prev, next, emis);
+  }
+
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void forward_next(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    std::size_t index,
+                    std::vector<U>& alpha,
+                    L lsum = L()) {
+    Workspace<U> ws;
+    forward_next(observed, initial, transition, emission, index, alpha, ws, lsum);
   }
 
 } // namespace hmm
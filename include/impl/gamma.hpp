@@ -32,6 +32,9 @@
 #include "efun.hpp"
 #include "fwd.hpp"
 #include "infinity.hpp"
+#include "logsum.hpp"
+#include "trellis.hpp"
+#include "workspace.hpp"
 
 
 namespace ci {
@@ -45,25 +48,32 @@ namespace hmm {
   //  : Inefficient in time due to backward_index() calls; memory is good
   //  : Calculates all gam values (nstates * nobservations)
   //=========
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LB = exact_logsum>
   void gamma_t_full(const O& observed,
                     const I& initial,
                     const T& transition,
                     const E& emission,
-                    std::vector < std::vector<U> >& gam) {
+                    std::vector < std::vector<U> >& gam,
+                    Workspace<U>& ws,
+                    LF lfwd = LF(),
+                    LB lbkd = LB()) {
 
+    const details::EmitterScope<E> scope(ws.emitters, emission);
     std::size_t nstates = initial.size(), nobs = observed.size();
-    std::vector<U> alpha(nstates, 0), beta(nstates, 0);
+    std::vector<U>& alpha = ws.alphaG;
+    std::vector<U>& beta = ws.beta;
+    alpha.assign(nstates, 0), beta.assign(nstates, 0);
 
     U normalizer = inf<U>();
     for ( std::size_t s = 0; s < nobs; ++s ) {
-      forward_next(observed, initial, transition, emission, s+1, alpha);
-      backward_index(observed, initial, transition, emission, s+1, beta);
+      forward_next(observed, initial, transition, emission, s+1, alpha, ws, lfwd);
+      backward_index(observed, initial, transition, emission, s+1, beta, ws, lbkd);
 
       normalizer = inf<U>();
       for ( std::size_t i = 0; i < nstates; ++i ) {
         gam[i][s] = elnproduct(alpha[i], beta[i]);
-        normalizer = elnsum(normalizer, gam[i][s]);
+        normalizer = lfwd(normalizer, gam[i][s]);
       } // for
 
       for ( std::size_t j = 0; j < nstates; ++j )
@@ -71,39 +81,105 @@ namespace hmm {
     } // for
   }
 
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LB = exact_logsum>
+  void gamma_t_full(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    std::vector < std::vector<U> >& gam,
+                    LF lfwd = LF(),
+                    LB lbkd = LB()) {
+    Workspace<U> ws;
+    gamma_t_full(observed, initial, transition, emission, gam, ws, lfwd, lbkd);
+  }
+
+namespace details {
+
+  //=================
+  // gamma_trellis()
+  //  : gam[s][i] = alpha[s][i] (x) beta[s][i], normalized over i, for the
+  //      first nobs rows
+  template <typename U, typename L>
+  void gamma_trellis(const Trellis<U>& alpha, const Trellis<U>& beta, std::size_t nobs,
+                     Trellis<U>& gam, L lsum) {
+    const std::size_t nstates = alpha.Width();
+    gam.Resize(nobs, nstates);
+    for ( std::size_t s = 0; s < nobs; ++s ) {
+      const U* const a = alpha[s];
+      const U* const b = beta[s];
+      U* const g = gam[s];
+      U normalizer = inf<U>();
+      for ( std::size_t i = 0; i < nstates; ++i ) {
+        g[i] = elnproduct(a[i], b[i]);
+        normalizer = lsum(normalizer, g[i]);
+      } // for
+
+      for ( std::size_t j = 0; j < nstates; ++j )
+        g[j] = elnproduct(g[j], -normalizer);
+    } // for
+  }
+
+} // namespace details
+
   //=========
   // gamma_m_full()
   //  : Evaluate the probability of q_t being in state i given an observation
   //    sequence and model
   //  : Inefficient in memory
-  //  : Calculates all gam values (nstates * nobservations)
+  //  : Calculates all gam values (nstates * nobservations); gam is resized
+  //    to one row per observation, row s holding position s
+  //  : alpha and beta trellises are kept in ws
   //=========
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LB = exact_logsum>
   void gamma_m_full(const O& observed,
                     const I& initial,
                     const T& transition,
                     const E& emission,
-                    std::vector < std::vector<U> >& gam) {
-
-    std::size_t nstates = initial.size(), nobserved = observed.size();
-    std::vector< std::vector<U> > alpha(nstates), beta(nstates);
-    for ( std::size_t i = 0; i < nstates; ++i )
-      alpha[i].resize(nobserved, 0), beta[i].resize(nobserved, 0);
-
-    forward_full(observed, initial, transition, emission, nobserved, alpha);
-    backward_full(observed, initial, transition, emission, 1, beta);
+                    Trellis<U>& gam,
+                    Workspace<U>& ws,
+                    LF lfwd = LF(),
+                    LB lbkd = LB()) {
+
+    const std::size_t nobserved = observed.size();
+    if ( nobserved < 1 )
+      return;
+
+    forward_full(observed, initial, transition, emission, nobserved, ws.alphaT, ws, lfwd);
+    backward_full(observed, initial, transition, emission, 1, ws.betaT, ws, lbkd);
+    details::gamma_trellis(ws.alphaT, ws.betaT, nobserved, gam, lfwd);
+  }
 
-    U normalizer = inf<U>();
-    for ( std::size_t s = 0; s < nobserved; ++s ) {
-      normalizer = inf<U>();
-      for ( std::size_t i = 0; i < nstates; ++i ) {
-        gam[i][s] = elnproduct(alpha[i][s], beta[i][s]);
-        normalizer = elnsum(normalizer, gam[i][s]);
-      } // for
+  //  : [state][time] version: fills gam[i][s] in arrays sized by the
+  //    caller, by way of ws.gamT
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LB = exact_logsum>
+  void gamma_m_full(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    std::vector < std::vector<U> >& gam,
+                    Workspace<U>& ws,
+                    LF lfwd = LF(),
+                    LB lbkd = LB()) {
+    gamma_m_full(observed, initial, transition, emission, ws.gamT, ws, lfwd, lbkd);
+    for ( std::size_t s = 0; s < observed.size(); ++s )
+      for ( std::size_t i = 0; i < gam.size(); ++i )
+        gam[i][s] = ws.gamT[s][i];
+  }
 
-      for ( std::size_t j = 0; j < nstates; ++j )
-        gam[j][s] = elnproduct(gam[j][s], -normalizer);
-    } // for
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LB = exact_logsum>
+  void gamma_m_full(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    std::vector < std::vector<U> >& gam,
+                    LF lfwd = LF(),
+                    LB lbkd = LB()) {
+    Workspace<U> ws;
+    gamma_m_full(observed, initial, transition, emission, gam, ws, lfwd, lbkd);
   }
 
   //=========
@@ -112,7 +188,8 @@ namespace hmm {
   //    sequence and model
   //  : Calculates one time ('index') slice for gam (nstates * 1)
   //=========
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
   void gamma(const O& observed,
              const I& initial,
              const T& transition,
@@ -120,22 +197,39 @@ namespace hmm {
              std::size_t index,
              const std::vector<U>& beta,
              std::vector<U>& alpha,
-             std::vector<U>& gam) {
+             std::vector<U>& gam,
+             Workspace<U>& ws,
+             L lsum = L()) {
 
     std::size_t nstates = initial.size();
 
-    forward_next(observed, initial, transition, emission, index, alpha);
+    forward_next(observed, initial, transition, emission, index, alpha, ws, lsum);
 
     U normalizer = inf<U>();
     for ( std::size_t i = 0; i < nstates; ++i ) {
       gam[i] = elnproduct(alpha[i], beta[i]);
-      normalizer = elnsum(normalizer, gam[i]);
+      normalizer = lsum(normalizer, gam[i]);
     } // for
 
     for ( std::size_t j = 0; j < nstates; ++j )
       gam[j] = elnproduct(gam[j], -normalizer);
   }
 
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void gamma(const O& observed,
+             const I& initial,
+             const T& transition,
+             const E& emission,
+             std::size_t index,
+             const std::vector<U>& beta,
+             std::vector<U>& alpha,
+             std::vector<U>& gam,
+             L lsum = L()) {
+    Workspace<U> ws;
+    gamma(observed, initial, transition, emission, index, beta, alpha, gam, ws, lsum);
+  }
+
 } // namespace hmm
 
 } // namespace ci
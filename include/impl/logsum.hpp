@@ -0,0 +1,150 @@
+/*
+  FILE: logsum.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 09:14:27 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef LOGSUM_HMM_R_HPP
+#define LOGSUM_HMM_R_HPP
+
+#include <cmath>
+#include <cstddef>
+
+#include "efun.hpp"
+#include "infinity.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ----------------
+    Log-add engines
+    ----------------
+    Every kernel that sums in log space takes one of these function objects
+      as its final (defaulted) argument.  exact_logsum is the default and
+      gives results identical to elnsum().
+
+    exact_logsum :
+      elnsum(); two libm calls per addition
+
+    fast_logsum :
+      Table lookup with linear interpolation, in the style of HMMER's FLogsum().
+      ln(1 + exp(-d)) is tabulated for d in [0, 16] at steps of h = 1/256.
+      The second derivative of ln(1 + exp(-d)) never exceeds 1/4, so the
+        interpolation error is at most h*h/32 < 4.8e-7, and the correction
+        dropped for d > 16 is at most ln(1 + exp(-16)) < 1.2e-7.
+      Guaranteed:  |fast_logsum()(x, y) - elnsum(x, y)| <= fast_logsum::bound
+        before rounding to the result type
+  */
+
+  //==============
+  // exact_logsum
+  //==============
+  struct exact_logsum {
+    template <typename T>
+    inline T operator()(T x, T y) const {
+      return(elnsum(x, y));
+    }
+  };
+
+  namespace details {
+    //===============
+    // LogsumTable
+    //  : ln(1 + exp(-i/Scale)) for i in [0, Size)
+    //  : built once, on first use
+    //===============
+    struct LogsumTable {
+      static constexpr int Scale = 256;
+      static constexpr int Max = 16;
+      static constexpr std::size_t Size = Max * Scale + 2;
+
+      LogsumTable() {
+        for ( std::size_t i = 0; i < Size; ++i )
+          values_[i] = static_cast<float>(std::log1p(std::exp(-static_cast<double>(i) / Scale)));
+      }
+
+      inline float operator[](std::size_t i) const
+        { return(values_[i]); }
+
+    private:
+      float values_[Size];
+    };
+
+    inline const LogsumTable& logsum_table() {
+      static const LogsumTable table;
+      return(table);
+    }
+  } // namespace details
+
+  //=============
+  // fast_logsum
+  //=============
+  struct fast_logsum {
+    static constexpr double bound = 6e-7;
+
+    fast_logsum() : table_(details::logsum_table())
+      { }
+
+    template <typename T>
+    inline T operator()(T x, T y) const {
+      static const T infinite = inf<T>();
+      if ( x == infinite )
+        return(y);
+      else if ( y == infinite )
+        return(x);
+
+      const T mx = (x > y) ? x : y;
+      const T d = (x > y) ? x - y : y - x;
+      if ( !(d < details::LogsumTable::Max) )
+        return(mx);
+
+      const T pos = d * details::LogsumTable::Scale;
+      const std::size_t idx = static_cast<std::size_t>(pos);
+      const T frac = pos - static_cast<T>(idx);
+      return(mx + table_[idx] + frac * (table_[idx+1] - table_[idx]));
+    }
+
+  private:
+    const details::LogsumTable& table_;
+  };
+
+  //=================
+  // logsum_policy<>
+  //  : picks a log-add engine for each kernel used during training
+  //=================
+  template <typename F = exact_logsum, typename B = exact_logsum,
+            typename X = exact_logsum, typename A = exact_logsum>
+  struct logsum_policy {
+    typedef F forward_type;    // forward recursion and gamma normalization
+    typedef B backward_type;   // backward recursion (including BackCache<>)
+    typedef X xi_type;         // xi normalization
+    typedef A accumulate_type; // sufficient statistics accumulation in train*()
+  };
+
+  typedef logsum_policy<> exact_policy;
+  typedef logsum_policy<fast_logsum, fast_logsum, fast_logsum, fast_logsum> fast_policy;
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // LOGSUM_HMM_R_HPP
@@ -0,0 +1,238 @@
+/*
+  FILE: mask.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Mon Oct 19 09:12:44 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef MASK_HMM_R_HPP
+#define MASK_HMM_R_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include "efun.hpp"
+#include "infinity.hpp"
+#include "stats.hpp"
+#include "train.hpp"
+#include "workspace.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ---------------------
+    State Constraint Masks
+    ---------------------
+    A StateMask names the states allowed at each position, e.g. from
+      partial labels or excluded regions.  Rather than thread a mask
+      through every kernel, each distinct set of allowed states gets its
+      own copy of the alphabet: symbol m at a position whose set is k is
+      rewritten as m + k M (mask_sequence()), and column m + k M of the
+      expanded emission matrix is column m with every state outside set k
+      at log-zero (mask_emission()).  Set 0 is every state, so positions
+      without a constraint keep their symbols.
+
+    The expanded emissions are sparse, so the generic forward, backward,
+      gamma, xi and Viterbi kernels bind ws.emitters to them and compute
+      only the allowed states at each position (see EmitterScope<>).
+      Disallowed states are skipped, not carried along as log-zero, and
+      the work at a position follows the size of its set.
+
+    train_masked() runs estep() on the expanded model, adds the counts of
+      every copy of a symbol back onto the symbol (unmask_statistics())
+      and re-estimates the original model with mstep(), so all positions
+      share one set of emission parameters.
+
+    The fixed-size kernels (fixed.hpp) do not skip states; pass masked
+      sequences to estep(), evalp() and viterbi() directly.  The expanded
+      matrix has M K columns for K distinct sets, and emission rows must
+      be dense.
+  */
+
+  //============
+  // StateMask
+  //   : Allowed states at each of npositions positions
+  //   : Allow() narrows [first, last) to a set of states; overlapping
+  //       calls intersect, and positions never narrowed allow every state
+  //   : Each distinct set is kept once; Set(0) is every state
+  struct StateMask {
+
+    //=============
+    // Constructor
+    StateMask(std::size_t nstates = 0, std::size_t npositions = 0)
+      { Reset(nstates, npositions); }
+
+    //=========
+    // Reset()
+    void Reset(std::size_t nstates, std::size_t npositions) {
+      std::vector<std::size_t> all(nstates);
+      for ( std::size_t i = 0; i < nstates; ++i )
+        all[i] = i;
+      sets_.assign(1, all);
+      ids_.clear();
+      ids_[all] = 0;
+      at_.assign(npositions, 0);
+    }
+
+    //=========
+    // Allow()
+    //  : caller guarantees first <= last <= size() and states < NStates()
+    void Allow(std::size_t first, std::size_t last, std::vector<std::size_t> states) {
+      std::sort(states.begin(), states.end());
+      states.erase(std::unique(states.begin(), states.end()), states.end());
+      std::vector<std::size_t> both;
+      std::uint32_t from = 0, to = 0; // last narrowing made; runs of positions share it
+      bool cached = false;
+      for ( std::size_t s = first; s < last; ++s ) {
+        if ( !cached || at_[s] != from ) {
+          from = at_[s];
+          both.clear();
+          std::set_intersection(sets_[from].begin(), sets_[from].end(), states.begin(), states.end(),
+                                std::back_inserter(both));
+          to = id(both);
+          cached = true;
+        }
+        at_[s] = to;
+      } // for
+    }
+
+    //===========
+    // Allowed()
+    //  : allowed states summed over all positions
+    std::size_t Allowed() const {
+      std::size_t rtn = 0;
+      for ( std::size_t s = 0; s < at_.size(); ++s )
+        rtn += sets_[at_[s]].size();
+      return(rtn);
+    }
+
+    inline std::size_t operator[](std::size_t s) const { return(at_[s]); }
+    inline std::size_t size() const { return(at_.size()); }
+    inline std::size_t NStates() const { return(sets_[0].size()); }
+    inline std::size_t NSets() const { return(sets_.size()); }
+    inline const std::vector<std::size_t>& Set(std::size_t k) const { return(sets_[k]); }
+
+  private:
+    std::uint32_t id(const std::vector<std::size_t>& set) {
+      auto i = ids_.find(set);
+      if ( i != ids_.end() )
+        return(i->second);
+      const std::uint32_t k = static_cast<std::uint32_t>(sets_.size());
+      sets_.push_back(set);
+      ids_[set] = k;
+      return(k);
+    }
+
+    std::vector< std::vector<std::size_t> > sets_; // sorted states of each distinct set
+    std::map<std::vector<std::size_t>, std::uint32_t> ids_;
+    std::vector<std::uint32_t> at_; // set at each position
+  };
+
+  //=================
+  // mask_sequence()
+  //  : masked gets observed, with symbol m at a position in set k written
+  //      as m + k nsymbols
+  //  : S needs clear() and push_back(), e.g. PackedSequence<>
+  template <typename O, typename S>
+  void mask_sequence(const O& observed, const StateMask& mask, std::size_t nsymbols, S& masked) {
+    masked.clear();
+    for ( std::size_t s = 0; s < observed.size(); ++s )
+      masked.push_back(static_cast<std::size_t>(observed[s]) + mask[s] * nsymbols);
+  }
+
+  //=================
+  // mask_emission()
+  //  : masked gets one copy of emission's columns per set of mask, with
+  //      the states outside the set at log-zero
+  template <typename E, typename U>
+  void mask_emission(const E& emission, const StateMask& mask, std::vector< std::vector<U> >& masked) {
+    const std::size_t nstates = emission.size();
+    const std::size_t nsymbols = emission.empty() ? 0 : emission[0].size();
+    details::shape(masked, nstates, nsymbols * mask.NSets(), inf<U>());
+    for ( std::size_t k = 0; k < mask.NSets(); ++k ) {
+      for ( std::size_t j : mask.Set(k) )
+        std::copy(emission[j].begin(), emission[j].end(), masked[j].begin() + k * nsymbols);
+    } // for
+  }
+
+  //=====================
+  // unmask_statistics()
+  //  : adds statistics accumulated on a mask_emission() model to stats,
+  //      whose symbols are the original ones; counts for each copy
+  //      m + k M of symbol m go to m, with M = stats.NSymbols()
+  //  : caller guarantees matching numbers of states
+  template <typename U>
+  void unmask_statistics(const Statistics<U>& masked, Statistics<U>& stats) {
+    auto add = [](std::vector<U>& a, const std::vector<U>& b) {
+      for ( std::size_t i = 0; i < a.size(); ++i )
+        a[i] = elnsum(a[i], b[i]);
+    };
+
+    const std::size_t nsymbols = stats.NSymbols();
+    stats.nsequences += masked.nsequences;
+    stats.loglik += masked.loglik;
+    add(stats.initial, masked.initial);
+    add(stats.denominator, masked.denominator);
+    for ( std::size_t i = 0; i < stats.numeratorT.size(); ++i )
+      add(stats.numeratorT[i], masked.numeratorT[i]);
+    for ( std::size_t c = 0; c < masked.NSymbols(); ++c ) {
+      if ( !masked.numeratorE[c].empty() )
+        add(stats.Symbol(c % nsymbols), masked.numeratorE[c]);
+    } // for
+  }
+
+  //================
+  // train_masked()
+  //   : Re-estimate model parameters as train() does, with every path
+  //       kept inside mask
+  //   : observed holds mask_sequence() symbols; initial, transition and
+  //       emission are the original model
+  //   : The expanded emissions and statistics live in ws.masked and
+  //       ws.half, so nothing is allocated after the first iteration
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void train_masked(const O& observed,
+                    const StateMask& mask,
+                    I& initial,
+                    T& transition,
+                    E& emission,
+                    Workspace<U>& ws,
+                    P policy = P()) {
+    const std::size_t nstates = initial.size(), nsymbols = emission[0].size();
+    mask_emission(emission, mask, ws.masked);
+    ws.half.Reset(nstates, nsymbols * mask.NSets());
+    estep(observed, initial, transition, ws.masked, ws.half, ws, policy);
+    ws.stats.Reset(nstates, nsymbols);
+    unmask_statistics(ws.half, ws.stats);
+    mstep(ws.stats, initial, transition, emission);
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // MASK_HMM_R_HPP
@@ -0,0 +1,212 @@
+/*
+  FILE: online.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 11:02:45 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef ONLINE_HMM_R_HPP
+#define ONLINE_HMM_R_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "bkd.hpp"
+#include "efun.hpp"
+#include "fwd.hpp"
+#include "infinity.hpp"
+#include "logsum.hpp"
+#include "trellis.hpp"
+#include "workspace.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  //=============
+  // OnlineEM<>
+  //   : Stepwise (mini-batch) EM over a stream of observation blocks
+  //   : Each Update() runs forward-backward over one block, starting from
+  //       the state distribution carried over from the end of the last
+  //       block, and blends that block's expected counts into running
+  //       sufficient statistics with step size (k+2)^-decay
+  //   : Parameters are re-estimated after every block, so a usable model
+  //       exists after a single pass through the data
+  //   : Memory is O(N*blocksize + N*N + N*M); independent of total length.
+  //       The alpha and beta trellises live in a Workspace<> kept between
+  //       blocks, so only a block longer than any before it allocates
+  //   : Symbols may be appended to emission between calls to Update()
+  //   : Finish() leaves initial in linear space, just as train() does
+  template <typename I, typename T, typename E, typename L = exact_logsum>
+  struct OnlineEM {
+    typedef typename I::value_type U;
+
+    //=============
+    // Constructor
+    OnlineEM(I& initial, T& transition, E& emission, double decay = 0.6, L lsum = L())
+                      : nblocks_(0), decay_(decay), initial_(initial),
+                        transition_(transition), emission_(emission), lsum_(lsum)
+      { }
+
+    //==========
+    // Update()
+    //  : returns log P(block | model, carried state distribution)
+    template <typename O>
+    U Update(const O& block) {
+      const std::size_t nobs = block.size();
+      const std::size_t nstates = initial_.size();
+      if ( 0 == nobs )
+        return(0);
+
+      if ( prior_.empty() )
+        prior_.assign(initial_.begin(), initial_.end());
+      resize();
+
+      Trellis<U>& alpha = ws_.alphaT;
+      Trellis<U>& beta = ws_.betaT;
+      forward_full(block, prior_, transition_, emission_, nobs, alpha, ws_, lsum_);
+      backward_full(block, prior_, transition_, emission_, 1, beta, ws_, lsum_);
+
+      U loglik = inf<U>();
+      for ( std::size_t i = 0; i < nstates; ++i )
+        loglik = lsum_(loglik, alpha[nobs-1][i]);
+
+      // this block's expected counts
+      for ( std::size_t i = 0; i < nstates; ++i ) {
+        std::fill(blockT_[i].begin(), blockT_[i].end(), 0);
+        std::fill(blockE_[i].begin(), blockE_[i].end(), 0);
+      } // for
+
+      U normalizer = inf<U>();
+      for ( std::size_t s = 0; s < nobs; ++s ) {
+        normalizer = inf<U>();
+        for ( std::size_t i = 0; i < nstates; ++i )
+          normalizer = lsum_(normalizer, elnproduct(alpha[s][i], beta[s][i]));
+
+        for ( std::size_t i = 0; i < nstates; ++i ) {
+          const double g = eexp(elnproduct(elnproduct(alpha[s][i], beta[s][i]), -normalizer));
+          blockE_[i][block[s]] += g;
+          if ( 0 == s && 0 == nblocks_ )
+            start_[i] = g;
+        } // for
+
+        if ( s+1 == nobs )
+          break;
+        for ( std::size_t i = 0; i < nstates; ++i ) {
+          for ( std::size_t j = 0; j < nstates; ++j ) {
+            blockT_[i][j] += eexp(elnproduct(alpha[s][i],
+                                             elnproduct(transition_[i][j],
+                                                        elnproduct(emission_[j][block[s+1]],
+                                                                   elnproduct(beta[s+1][j], -normalizer)))));
+          } // for
+        } // for
+      } // for
+
+      // blend into running statistics
+      const double eta = (0 == nblocks_) ? 1.0 : std::pow(nblocks_ + 2.0, -decay_);
+      for ( std::size_t i = 0; i < nstates; ++i ) {
+        for ( std::size_t j = 0; j < nstates; ++j )
+          statsT_[i][j] = (1 - eta) * statsT_[i][j] + eta * blockT_[i][j];
+        for ( std::size_t m = 0; m < statsE_[i].size(); ++m )
+          statsE_[i][m] = (1 - eta) * statsE_[i][m] + eta * blockE_[i][m];
+      } // for
+      ++nblocks_;
+
+      // re-estimate; a state with no mass keeps its old parameters
+      for ( std::size_t i = 0; i < nstates; ++i ) {
+        double rowT = 0, rowE = 0;
+        for ( std::size_t j = 0; j < nstates; ++j )
+          rowT += statsT_[i][j];
+        for ( std::size_t m = 0; m < statsE_[i].size(); ++m )
+          rowE += statsE_[i][m];
+
+        if ( rowT > 0 ) {
+          for ( std::size_t j = 0; j < nstates; ++j )
+            transition_[i][j] = static_cast<U>(eln(statsT_[i][j] / rowT));
+        }
+        if ( rowE > 0 ) {
+          for ( std::size_t m = 0; m < statsE_[i].size(); ++m )
+            emission_[i][m] = static_cast<U>(eln(statsE_[i][m] / rowE));
+        }
+      } // for
+
+      // state distribution entering the next block
+      U tmpf = inf<U>();
+      for ( std::size_t j = 0; j < nstates; ++j ) {
+        tmpf = inf<U>();
+        for ( std::size_t i = 0; i < nstates; ++i )
+          tmpf = lsum_(tmpf, elnproduct(elnproduct(alpha[nobs-1][i], -loglik), transition_[i][j]));
+        prior_[j] = tmpf;
+      } // for
+      return(loglik);
+    }
+
+    //==========
+    // Finish()
+    //  : renormalizes the first block's gammas, as mstep() does; float
+    //      gammas over a long block can be off by 1e-3
+    void Finish() {
+      if ( 0 == nblocks_ )
+        return;
+      double sum = 0;
+      for ( std::size_t i = 0; i < start_.size(); ++i )
+        sum += start_[i];
+      for ( std::size_t i = 0; i < initial_.size(); ++i )
+        initial_[i] = static_cast<U>((sum > 0) ? start_[i] / sum : start_[i]);
+    }
+
+    //==========
+    // Blocks()
+    std::size_t Blocks() const
+      { return(nblocks_); }
+
+  private:
+    void resize() {
+      const std::size_t nstates = initial_.size();
+      const std::size_t nsymbols = emission_[0].size();
+      statsT_.resize(nstates), blockT_.resize(nstates);
+      statsE_.resize(nstates), blockE_.resize(nstates);
+      start_.resize(nstates, 0);
+      for ( std::size_t i = 0; i < nstates; ++i ) {
+        statsT_[i].resize(nstates, 0), blockT_[i].resize(nstates, 0);
+        statsE_[i].resize(nsymbols, 0), blockE_[i].resize(nsymbols, 0);
+      } // for
+    }
+
+  private:
+    std::size_t nblocks_;
+    const double decay_;
+    I& initial_;
+    T& transition_;
+    E& emission_;
+    L lsum_;
+    std::vector<U> prior_;
+    Workspace<U> ws_; // alphaT and betaT hold the current block
+    std::vector<double> start_;
+    std::vector< std::vector<double> > statsT_, statsE_;
+    std::vector< std::vector<double> > blockT_, blockE_;
+  };
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // ONLINE_HMM_R_HPP
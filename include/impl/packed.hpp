@@ -0,0 +1,195 @@
+/*
+  FILE: packed.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 21:12:37 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef PACKED_HMM_R_HPP
+#define PACKED_HMM_R_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ---------------------
+    Packed observations
+    ---------------------
+    Symbols are stored in 64-bit words at 2, 4 or 8 bits each (16 or 32
+      for larger alphabets), the narrowest width that holds the largest
+      symbol seen so far.  A width never straddles a word boundary, so
+      position i lives in word i / (64 / bits).  push_back() of a symbol
+      that does not fit repacks everything at the next width; this happens
+      at most four times.
+
+    operator[] returns the symbol by value; it is a shift and a mask,
+      cheaper than the float-to-index conversion it replaces.  Decode()
+      unpacks a run of positions a word at a time for sequential readers.
+      Sub() is a read-only view of a range (e.g. one record), which is
+      itself a valid observation sequence for every kernel.
+
+    value_type is the scoring type U, as for a std::vector<U> of
+      observations, so the kernels and the default Workspace<> pick the
+      same arithmetic either way.
+  */
+
+  //==================
+  // PackedSequence<>
+  template <typename U>
+  struct PackedSequence {
+    typedef U value_type;
+    struct Slice;
+
+    //=============
+    // Constructor
+    //  : nsymbols, when known, sets the width up front
+    explicit PackedSequence(std::size_t nsymbols = 4)
+      : bits_(2), lg_(5), mask_(3), n_(0)
+      { if ( nsymbols > 4 ) widen(nsymbols - 1); }
+
+    inline std::size_t size() const { return(n_); }
+    inline bool empty() const { return(0 == n_); }
+    inline std::size_t Bits() const { return(bits_); }
+    inline std::size_t Bytes() const { return(words_.size() * sizeof(std::uint64_t)); }
+
+    //============
+    // BytesFor()
+    //  : Bytes() of n symbols from an alphabet of nsymbols
+    static std::size_t BytesFor(std::size_t n, std::size_t nsymbols) {
+      std::size_t bits = 2;
+      while ( bits < 32 && ((nsymbols > 0 ? nsymbols - 1 : 0) >> bits) != 0 )
+        bits *= 2;
+      const std::size_t per = 64 / bits;
+      return((n + per - 1) / per * sizeof(std::uint64_t));
+    }
+
+    //==========
+    // clear()
+    //  : keeps the current width
+    inline void clear() { words_.clear(); n_ = 0; }
+
+    inline void reserve(std::size_t n)
+      { words_.reserve((n + (static_cast<std::size_t>(1) << lg_) - 1) >> lg_); }
+
+    //=============
+    // push_back()
+    inline void push_back(std::size_t symbol) {
+      if ( symbol > mask_ )
+        widen(symbol);
+      const std::size_t off = n_ & ((static_cast<std::size_t>(1) << lg_) - 1);
+      if ( 0 == off )
+        words_.push_back(0);
+      words_.back() |= static_cast<std::uint64_t>(symbol) << (off * bits_);
+      ++n_;
+    }
+
+    //==============
+    // operator[]()
+    inline std::size_t operator[](std::size_t i) const {
+      const std::size_t off = i & ((static_cast<std::size_t>(1) << lg_) - 1);
+      return(static_cast<std::size_t>((words_[i >> lg_] >> (off * bits_)) & mask_));
+    }
+
+    //==========
+    // Decode()
+    //  : writes the symbols at positions [first, last) to out
+    template <typename OutIter>
+    OutIter Decode(std::size_t first, std::size_t last, OutIter out) const {
+      const std::size_t per = static_cast<std::size_t>(1) << lg_;
+      std::size_t i = first;
+      while ( i < last ) {
+        std::uint64_t w = words_[i >> lg_] >> ((i & (per - 1)) * bits_);
+        const std::size_t stop = std::min(last, ((i >> lg_) + 1) << lg_);
+        for ( ; i < stop; ++i, w >>= bits_ )
+          *out++ = static_cast<std::size_t>(w & mask_);
+      } // while
+      return(out);
+    }
+
+    //=======
+    // Sub()
+    //  : view of n positions starting at first; valid while *this is unchanged
+    inline Slice Sub(std::size_t first, std::size_t n) const
+      { return(Slice(*this, first, n)); }
+
+  private:
+    //=========
+    // widen()
+    //  : repack at the narrowest width holding symbol
+    void widen(std::size_t symbol) {
+      std::size_t bits = bits_, lg = lg_;
+      while ( bits < 32 && (symbol >> bits) != 0 )
+        bits *= 2, --lg;
+      if ( bits == bits_ )
+        return;
+
+      PackedSequence<U> wider;
+      wider.bits_ = bits, wider.lg_ = lg;
+      wider.mask_ = (static_cast<std::uint64_t>(1) << bits) - 1;
+      wider.reserve(n_);
+      for ( std::size_t i = 0; i < n_; ++i )
+        wider.push_back((*this)[i]);
+      words_.swap(wider.words_);
+      bits_ = bits, lg_ = lg, mask_ = wider.mask_;
+    }
+
+    std::size_t bits_; // bits per symbol
+    std::size_t lg_;   // log2 of symbols per word
+    std::uint64_t mask_;
+    std::size_t n_;
+    std::vector<std::uint64_t> words_;
+  };
+
+  //=========================
+  // PackedSequence<>::Slice
+  template <typename U>
+  struct PackedSequence<U>::Slice {
+    typedef U value_type;
+
+    Slice(const PackedSequence<U>& s, std::size_t first, std::size_t n)
+      : seq_(&s), first_(first), n_(n)
+      { }
+
+    inline std::size_t size() const { return(n_); }
+    inline bool empty() const { return(0 == n_); }
+    inline std::size_t operator[](std::size_t i) const { return((*seq_)[first_ + i]); }
+
+    template <typename OutIter>
+    OutIter Decode(std::size_t first, std::size_t last, OutIter out) const
+      { return(seq_->Decode(first_ + first, first_ + last, out)); }
+
+  private:
+    const PackedSequence<U>* seq_;
+    std::size_t first_;
+    std::size_t n_;
+  };
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // PACKED_HMM_R_HPP
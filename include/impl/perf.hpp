@@ -0,0 +1,143 @@
+/*
+  FILE: perf.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Mon Oct 19 02:31:18 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef PERF_HMM_R_HPP
+#define PERF_HMM_R_HPP
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ci {
+
+namespace hmm {
+
+  //===============
+  // PerfCounters
+  //   : Hardware counters for the calling thread and any threads it starts
+  //       while counting (e.g., BackCache<>'s helper), user space only, via
+  //       perf_event_open(2)
+  //   : Each counter opens on its own.  Those the kernel refuses (no PMU
+  //       in a virtual machine, perf_event_paranoid, seccomp) read as not
+  //       Valid(); wall time is always measured
+  //   : Counts are scaled up when the kernel multiplexed a counter
+  class PerfCounters {
+  public:
+    enum Event { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, NEVENTS };
+
+    struct Sample {
+      double seconds;
+      std::array<std::uint64_t, NEVENTS> count;
+      std::array<bool, NEVENTS> valid;
+
+      inline bool Valid(Event e) const { return(valid[e]); }
+    };
+
+    PerfCounters() {
+      static const std::uint64_t config[NEVENTS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                     PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+      for ( int e = 0; e < NEVENTS; ++e ) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config[e];
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fd_[e] = static_cast<int>(::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if ( fd_[e] < 0 && why_.empty() )
+          why_ = std::strerror(errno);
+      } // for
+    }
+
+    ~PerfCounters() {
+      for ( int e = 0; e < NEVENTS; ++e ) {
+        if ( fd_[e] >= 0 )
+          ::close(fd_[e]);
+      } // for
+    }
+
+    inline bool Valid(Event e) const { return(fd_[e] >= 0); }
+
+    // why the first counter that failed to open was refused; empty if none
+    inline const std::string& Unavailable() const { return(why_); }
+
+    //=========
+    // Start()
+    void Start() {
+      for ( int e = 0; e < NEVENTS; ++e ) {
+        if ( fd_[e] >= 0 ) {
+          ::ioctl(fd_[e], PERF_EVENT_IOC_RESET, 0);
+          ::ioctl(fd_[e], PERF_EVENT_IOC_ENABLE, 0);
+        }
+      } // for
+      start_ = std::chrono::steady_clock::now();
+    }
+
+    //========
+    // Stop()
+    //  : counts since Start()
+    Sample Stop() {
+      Sample s;
+      s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+      for ( int e = 0; e < NEVENTS; ++e ) {
+        s.count[e] = 0, s.valid[e] = false;
+        if ( fd_[e] < 0 )
+          continue;
+        ::ioctl(fd_[e], PERF_EVENT_IOC_DISABLE, 0);
+        std::uint64_t v[3]; // value, time enabled, time running
+        if ( ::read(fd_[e], v, sizeof(v)) != static_cast<ssize_t>(sizeof(v)) || 0 == v[2] )
+          continue;
+        s.count[e] = (v[2] < v[1]) ? static_cast<std::uint64_t>(static_cast<double>(v[0]) * v[1] / v[2]) : v[0];
+        s.valid[e] = true;
+      } // for
+      return(s);
+    }
+
+  private:
+    PerfCounters(const PerfCounters&); // disabled purposefully
+    void operator=(const PerfCounters&); // disabled purposefully
+
+    int fd_[NEVENTS];
+    std::string why_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // PERF_HMM_R_HPP
@@ -0,0 +1,171 @@
+/*
+  FILE: plan.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 20:03:44 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef PLAN_HMM_R_HPP
+#define PLAN_HMM_R_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "packed.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    -----------------
+    Training planner
+    -----------------
+    The training engines reach the same model at different costs:
+      FULL     - train_full(): alpha, beta and gamma trellises (3 N T) and
+                   the xi trellis (N^2 T), time-major (trellis.hpp); forward
+                   and backward run once
+      STANDARD - train(): estep() over a BackCache<> of beta checkpoints
+                   (two segments of about max(10000, sqrt T) columns), then mstep()
+      MEM      - train_mem(): as STANDARD, with no Statistics<>; the output
+                   parameters hold the running sums
+      SPLIT    - train_split(): as STANDARD, with the forward and backward
+                   sweeps of each half of the observations on two threads
+                   (split.hpp)
+
+    Each recursion is a forward or backward sweep over the observations,
+      O(N^2 T) work.  FULL makes the fewest, two, and streams its
+      trellises in order.  STANDARD and MEM run forward twice (gamma and xi
+      keep their own alpha) and backward once, or twice when the
+      observations outgrow one BackCache<> segment.  SPLIT makes three
+      sweeps in all, one and a half on each of its two threads.  Its sums
+      are taken in another order, so it is never chosen automatically:
+      AUTO keeps models reproducible bit for bit across releases.
+
+    FULL's trellises grow with T without limit, so AUTO weighs it only
+      against an explicit budget; with none it keeps to the checkpointed
+      engines, as it always has.  Trellises kept in files (mapped; see
+      Workspace<>::Backing()) are left out of FULL's estimate.
+
+    Estimates cover the observations (bit-packed, as rHMM holds them; see
+      packed.hpp), model and scratch held during one iteration; they ignore allocator slack beyond a fixed per-vector
+      charge, so leave some headroom in a budget.
+  */
+
+  enum class Engine { AUTO, FULL, STANDARD, MEM, SPLIT };
+
+  //==============
+  // EnginePlan
+  struct EnginePlan {
+    Engine engine;
+    std::size_t bytes;      // estimated peak memory
+    std::size_t recursions; // forward and backward sweeps per iteration
+  };
+
+  //===============
+  // engine_name()
+  inline std::string engine_name(Engine e) {
+    switch ( e ) {
+      case Engine::FULL: return("full");
+      case Engine::STANDARD: return("standard");
+      case Engine::MEM: return("mem");
+      case Engine::SPLIT: return("split");
+      default: return("auto");
+    }
+  }
+
+  //===============
+  // plan_engine()
+  //  : estimates for one training iteration of engine e with values of type U
+  //  : mapped leaves FULL's file-backed trellises out
+  template <typename U>
+  EnginePlan plan_engine(Engine e, std::size_t nobs, std::size_t nstates, std::size_t nsymbols,
+                         bool mapped = false) {
+    static constexpr std::size_t PerVector = 40; // header plus allocator overhead
+    const std::size_t u = sizeof(U), n = nstates, t = nobs;
+    const std::size_t model = (n + n*n + n*nsymbols) * u + (2 + n) * PerVector;
+    const std::size_t stats = (2*n + n*n + n*nsymbols) * u + (3 + n + nsymbols) * PerVector;
+    const std::size_t columns = 7 * (n * u + PerVector) + n * (n * u + PerVector);
+    const std::size_t emitters = n * nsymbols * sizeof(std::size_t) + nsymbols * PerVector;
+
+    EnginePlan p;
+    p.engine = e;
+    p.bytes = PackedSequence<U>::BytesFor(t, nsymbols) + model;
+    if ( e == Engine::FULL ) {
+      p.bytes += (mapped ? 0 : (3*n + n*n) * t * u) + 4 * PerVector + stats + emitters;
+      p.recursions = 2;
+      return(p);
+    }
+
+    // BackCache<>: a checkpoint per segment, the segment being consumed and
+    //  the next one, which a helper thread recomputes ahead of time
+    const std::size_t segment = std::max(static_cast<std::size_t>(10000),
+                                         static_cast<std::size_t>(std::sqrt(t)));
+    const std::size_t cached = std::min(t, 2 * segment) + t / segment;
+    if ( e == Engine::SPLIT ) { // checkpoints and one segment per thread, a second Statistics<>
+      const std::size_t flat = (t / segment + 2 + 2 * std::min(t, segment) + 2 * (3 + n)) * n * u;
+      p.bytes += flat + 2 * stats;
+      p.recursions = 3;
+      return(p);
+    }
+    p.bytes += cached * (n * u + PerVector) + columns + emitters;
+    p.bytes += (e == Engine::MEM) ? model + n * u : stats;
+    p.recursions = (t > segment) ? 4 : 3;
+    return(p);
+  }
+
+  //=================
+  // choose_engine()
+  //  : the fastest engine whose estimate fits in budget bytes (0: no limit)
+  //  : if none fits, the smallest
+  //  : FULL only competes under a budget
+  //  : ties go to STANDARD, then MEM, then FULL
+  template <typename U>
+  EnginePlan choose_engine(std::size_t nobs, std::size_t nstates, std::size_t nsymbols, std::size_t budget,
+                           bool mapped = false) {
+    const Engine order[] = { Engine::STANDARD, Engine::MEM, Engine::FULL };
+    std::vector<EnginePlan> plans;
+    for ( Engine e : order ) {
+      if ( e != Engine::FULL || budget )
+        plans.push_back(plan_engine<U>(e, nobs, nstates, nsymbols, mapped));
+    } // for
+
+    const EnginePlan* best = 0;
+    const EnginePlan* smallest = &plans[0];
+    for ( const EnginePlan& p : plans ) {
+      if ( p.bytes < smallest->bytes )
+        smallest = &p;
+      if ( budget && p.bytes > budget )
+        continue;
+      if ( !best || p.recursions < best->recursions )
+        best = &p;
+    } // for
+    return(best ? *best : *smallest);
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // PLAN_HMM_R_HPP
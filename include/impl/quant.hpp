@@ -0,0 +1,200 @@
+/*
+  FILE: quant.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Mon Oct 19 00:58:21 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef QUANT_HMM_R_HPP
+#define QUANT_HMM_R_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "workspace.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ---------------------
+    Quantized Viterbi
+    ---------------------
+    viterbi() only adds and compares log scores, so it runs as well on
+      integers.  QuantizedModel rounds every log transition and emission
+      score to int16 at one scale, s = MaxScore / (largest |score|), and
+      viterbi_quantized() runs the same max-plus recursion on those.
+      int16 fits twice the lanes of float in a vector register; the inner
+      loops are laid out (column-major, [from][to] and [symbol][state])
+      so the compiler vectorizes them with packed 16-bit add and max.
+
+    Range: after each step the column is shifted so its best state is 0.
+      Every state then lies within 2 MaxScore of the best (the best state
+      of the last column reaches each state with one transition and one
+      emission), and a step's intermediate sums stay within 4 MaxScore,
+      inside int16 for MaxScore = 8000.  States below the first column's
+      floor of -2 MaxScore can never become the best, so clamping them
+      there changes nothing.
+
+    Agreement: each decoded state is the best state of its column, as in
+      viterbi().  Rounding error is at most 1/(2s) per score, so paths
+      differ only where two states' float scores are within the
+      accumulated rounding of each other (near-ties).  Scores are finite
+      log values in practice; a log-zero or NaN score makes the model
+      not Valid(), and callers fall back on the float kernels, which
+      rank log-zero below every finite score.
+  */
+
+  //==================
+  // QuantizedModel
+  struct QuantizedModel {
+    static constexpr int MaxScore = 8000;
+
+    QuantizedModel() : nstates_(0), nsymbols_(0), scale_(0), valid_(false)
+      { }
+
+    template <typename I, typename T, typename E>
+    QuantizedModel(const I& initial, const T& transition, const E& emission)
+        : nstates_(initial.size()), nsymbols_(emission.empty() ? 0 : emission[0].size()),
+          scale_(0), valid_(nstates_ > 0) {
+      double largest = 0;
+      for ( std::size_t i = 0; i < nstates_; ++i ) {
+        valid_ = valid_ && std::isfinite(static_cast<double>(initial[i]));
+        for ( std::size_t j = 0; j < nstates_; ++j )
+          check(transition[i][j], largest);
+        for ( std::size_t m = 0; m < nsymbols_; ++m )
+          check(emission[i][m], largest);
+      } // for
+      if ( !valid_ )
+        return;
+
+      scale_ = (largest > 0) ? MaxScore / largest : 1;
+      initial_.resize(nstates_), transition_.resize(nstates_ * nstates_), emission_.resize(nsymbols_ * nstates_);
+      for ( std::size_t i = 0; i < nstates_; ++i ) {
+        initial_[i] = static_cast<std::int16_t>(std::lround(std::max(initial[i] * scale_, -2.0 * MaxScore)));
+        for ( std::size_t j = 0; j < nstates_; ++j )
+          transition_[i * nstates_ + j] = quantize(transition[i][j]);
+        for ( std::size_t m = 0; m < nsymbols_; ++m )
+          emission_[m * nstates_ + i] = quantize(emission[i][m]);
+      } // for
+    }
+
+    inline bool Valid() const { return(valid_); }
+    inline double Scale() const { return(scale_); }
+    inline std::size_t NStates() const { return(nstates_); }
+
+    // [state]; [from * NStates() + to]; [symbol * NStates() + state]
+    inline const std::int16_t* Initial() const { return(initial_.data()); }
+    inline const std::int16_t* Transition() const { return(transition_.data()); }
+    inline const std::int16_t* Emission(std::size_t symbol) const
+      { return(emission_.data() + symbol * nstates_); }
+
+  private:
+    template <typename V>
+    inline void check(V v, double& largest) {
+      const double d = static_cast<double>(v);
+      valid_ = valid_ && std::isfinite(d);
+      largest = std::max(largest, std::abs(d));
+    }
+
+    template <typename V>
+    inline std::int16_t quantize(V v) const
+      { return(static_cast<std::int16_t>(std::lround(v * scale_))); }
+
+    std::size_t nstates_, nsymbols_;
+    double scale_;
+    bool valid_;
+    std::vector<std::int16_t> initial_, transition_, emission_;
+  };
+
+  //=====================
+  // viterbi_quantized()
+  //  - viterbi() on model's int16 scores; same output up to near-ties
+  //  - returns false, writing nothing, if model is not Valid()
+  //  - scratch space comes from ws; model may be shared across threads
+  //=====================
+  template <typename O, typename OutIter, typename U>
+  bool viterbi_quantized(const O& observed,
+                         const QuantizedModel& model,
+                         OutIter out,
+                         Workspace<U>& ws) {
+    if ( !model.Valid() )
+      return(false);
+    const std::size_t nobs = observed.size();
+    if ( 0 == nobs )
+      return(true);
+
+    typedef std::int16_t Q;
+    const std::size_t nstates = model.NStates();
+    ws.quant.resize(2 * nstates);
+    Q* delta = ws.quant.data();
+    Q* cand = delta + nstates;
+
+    // first column, shifted so its best is 0; floor at -2 MaxScore
+    const Q* emis = model.Emission(static_cast<std::size_t>(observed[0]));
+    std::size_t index = 0;
+    for ( std::size_t i = 0; i < nstates; ++i ) {
+      cand[i] = static_cast<Q>(std::max(model.Initial()[i] + emis[i], -2 * QuantizedModel::MaxScore));
+      if ( cand[i] > cand[index] )
+        index = i;
+    } // for
+    *out++ = index;
+    for ( std::size_t i = 0; i < nstates; ++i )
+      delta[i] = static_cast<Q>(std::max(cand[i] - cand[index], -2 * QuantizedModel::MaxScore));
+
+    for ( std::size_t s = 1; s < nobs; ++s ) {
+      // cand[j] = max_k delta[k] + transition[k][j]; vectorizes across j
+      const Q* trans = model.Transition();
+      for ( std::size_t j = 0; j < nstates; ++j )
+        cand[j] = static_cast<Q>(delta[0] + trans[j]);
+      for ( std::size_t k = 1; k < nstates; ++k ) {
+        const Q dk = delta[k];
+        trans += nstates;
+        for ( std::size_t j = 0; j < nstates; ++j )
+          cand[j] = std::max(cand[j], static_cast<Q>(dk + trans[j]));
+      } // for
+
+      emis = model.Emission(static_cast<std::size_t>(observed[s]));
+      for ( std::size_t j = 0; j < nstates; ++j )
+        cand[j] = static_cast<Q>(cand[j] + emis[j]);
+      index = 0;
+      for ( std::size_t j = 1; j < nstates; ++j ) {
+        if ( cand[j] > cand[index] )
+          index = j;
+      } // for
+      *out++ = index;
+
+      const Q best = cand[index];
+      for ( std::size_t j = 0; j < nstates; ++j )
+        delta[j] = static_cast<Q>(cand[j] - best);
+    } // for
+    return(true);
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // QUANT_HMM_R_HPP
@@ -0,0 +1,122 @@
+/*
+  FILE: reduce.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Mon Oct 19 01:12:40 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef REDUCE_HMM_R_HPP
+#define REDUCE_HMM_R_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "fixed.hpp"
+#include "stats.hpp"
+#include "train.hpp"
+#include "workspace.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ---------------------------
+    Deterministic Reductions
+    ---------------------------
+    Log-space sums are not associative in floating point.  Statistics
+      summed in whatever order threads happen to finish would change from
+      run to run, and with the number of threads.
+
+    estep_records() cuts its sequences into at most ReduceParts contiguous
+      parts whose boundaries depend only on the number of sequences, never
+      on nthreads.  Each part accumulates its sequences in order into its
+      own Statistics<>, and reduce_ordered() combines the parts in a fixed
+      pairwise tree: (0,1) (2,3) ..., then (0,2) (4,6) ..., and so on.
+      Threads only decide who computes a part, so the statistics, and the
+      model mstep() makes of them, are bit-identical for any nthreads.
+
+    Cost: parts - 1 Merge() calls of O(N^2 + N M) each, serially, against
+      an E-step that is O(N^2) per observation.
+  */
+
+  constexpr std::size_t ReduceParts = 64;
+
+  //==================
+  // reduce_ordered()
+  //  : parts[0] becomes the sum of all parts; the tree's shape depends
+  //      only on parts.size()
+  template <typename U>
+  void reduce_ordered(std::vector< Statistics<U> >& parts) {
+    for ( std::size_t stride = 1; stride < parts.size(); stride *= 2 ) {
+      for ( std::size_t i = 0; i + stride < parts.size(); i += 2 * stride )
+        parts[i].Merge(parts[i + stride]);
+    } // for
+  }
+
+  //=================
+  // estep_records()
+  //  : estep_auto() over independent sequences on up to nthreads threads
+  //  : adds to whatever stats already holds, which sets the dimensions
+  //  : same result, bit for bit, for every nthreads
+  template <typename S, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void estep_records(const std::vector<S>& sequences,
+                     const I& initial,
+                     const T& transition,
+                     const E& emission,
+                     Statistics<U>& stats,
+                     std::size_t nthreads,
+                     P policy = P()) {
+    const std::size_t nseqs = sequences.size();
+    if ( 0 == nseqs )
+      return;
+
+    const std::size_t nparts = std::min(nseqs, ReduceParts);
+    std::vector< Statistics<U> > parts(nparts, Statistics<U>(stats.NStates(), stats.NSymbols()));
+    std::atomic<std::size_t> next(0);
+    auto work = [&]() {
+      Workspace<U> ws;
+      for ( std::size_t p = next++; p < nparts; p = next++ ) {
+        for ( std::size_t q = p * nseqs / nparts; q < (p + 1) * nseqs / nparts; ++q )
+          estep_auto(sequences[q], initial, transition, emission, parts[p], ws, policy);
+      } // for
+    };
+
+    std::vector<std::thread> threads;
+    for ( std::size_t t = 1; t < std::min(nthreads, nparts); ++t )
+      threads.push_back(std::thread(work));
+    work();
+    for ( std::size_t t = 0; t < threads.size(); ++t )
+      threads[t].join();
+
+    reduce_ordered(parts);
+    stats.Merge(parts[0]);
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // REDUCE_HMM_R_HPP
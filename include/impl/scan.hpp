@@ -0,0 +1,326 @@
+/*
+  FILE: scan.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 18:26:53 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef SCAN_HMM_R_HPP
+#define SCAN_HMM_R_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include "efun.hpp"
+#include "fwd.hpp"
+#include "infinity.hpp"
+#include "logsum.hpp"
+#include "step.hpp"
+#include "viterbi.hpp"
+#include "workspace.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ------------------------
+    Parallel-in-time forward
+    ------------------------
+    The forward recursion is a chain of (log-sum, +) matrix products:
+      alpha_s = alpha_(s-1) (x) A_s, with A_s[i][j] = t[i][j] + e[j][o_s].
+    The product is associative.  The observations are cut into chunks;
+      each chunk after the first is reduced to one N x N transfer matrix
+      on its own thread (N forward passes, one per entry state), while
+      the first chunk runs the ordinary forward recursion.  A scan over
+      the chunk summaries then gives alpha at every chunk boundary.
+
+    Work is O(N^3 T) against O(N^2 T) for forward_index(), so chunk 0
+      gets N times as many observations as the others to even out the
+      threads.  Expect speedups once nthreads is large relative to N.
+
+    Results differ from evalp() only by rounding (the sums are grouped
+      differently).
+
+    ------------------------
+    Parallel-in-time Viterbi
+    ------------------------
+    The same idea over the (max, +) semiring: a chunk's transfer matrix
+      holds the best score from each entry state to each exit state, and
+      the scan yields delta at every chunk boundary.  viterbi() reports
+      the best state of delta at each position, so no traceback is needed:
+      with its entry delta in hand, every chunk re-runs the ordinary
+      recursion on its own thread.
+
+    The boundary deltas match viterbi()'s only up to rounding.  max itself
+      is exact, but each transfer matrix sums a chunk's scores in a
+      different order than the sequential recursion does, and float
+      addition is not associative.  Output therefore matches viterbi()
+      except where two states tie to within that rounding.
+  */
+
+namespace details {
+
+  //================
+  // chunk_bounds()
+  //  : chunk c covers [bounds[c], bounds[c+1]); chunk 0 gets lead shares
+  //      of the observations and every other chunk gets one
+  inline std::vector<std::size_t> chunk_bounds(std::size_t nobs, std::size_t nchunks, std::size_t lead) {
+    static constexpr std::size_t MinChunk = 1024;
+    nchunks = std::max(static_cast<std::size_t>(1), std::min(nchunks, nobs / MinChunk));
+    const std::size_t share = nobs / (lead + nchunks - 1);
+    if ( 0 == share )
+      nchunks = 1;
+    std::vector<std::size_t> bounds(1, 0);
+    bounds.push_back((1 == nchunks) ? nobs : nobs - share * (nchunks - 1));
+    for ( std::size_t c = 2; c <= nchunks; ++c )
+      bounds.push_back(bounds.back() + share);
+    return(bounds);
+  }
+
+  //==================
+  // chunk_transfer()
+  //  : M[i][j] = ln P(o[first, last), q_(last-1) = j | q_(first-1) = i)
+  template <typename O, typename T, typename E, typename U, typename L>
+  void chunk_transfer(const O& observed,
+                      const T& transition,
+                      const E& emission,
+                      std::size_t first,
+                      std::size_t last,
+                      std::vector< std::vector<U> >& M,
+                      L lsum) {
+    const std::size_t nstates = transition.size();
+    std::vector<U> lcl(nstates);
+    M.resize(nstates);
+    for ( std::size_t i = 0; i < nstates; ++i ) {
+      std::vector<U>& col = M[i];
+      col.resize(nstates);
+      for ( std::size_t j = 0; j < nstates; ++j )
+        col[j] = elnproduct(transition[i][j], emission[j][observed[first]]);
+
+      for ( std::size_t s = first+1; s < last; ++s ) {
+        lcl.assign(col.begin(), col.end());
+        step_forward(LogRing<U, L>(lsum), Span(nstates), Span(nstates), transition,
+                     [&](std::size_t k) { return(lcl[k]); },
+                     [&](std::size_t j, U v) { col[j] = v; },
+                     [&](std::size_t j) { return(emission[j][observed[s]]); });
+      } // for
+    } // for
+  }
+
+  //=========================
+  // chunk_transfer_maxplus()
+  //  : M[i][j] = best ln P(o[first, last), q_(last-1) = j | q_(first-1) = i),
+  //      with ties and log-zero handled as viterbi() handles them
+  template <typename O, typename T, typename E, typename U>
+  void chunk_transfer_maxplus(const O& observed,
+                              const T& transition,
+                              const E& emission,
+                              std::size_t first,
+                              std::size_t last,
+                              std::vector< std::vector<U> >& M) {
+    const std::size_t nstates = transition.size();
+    std::vector<U> lcl(nstates);
+    M.resize(nstates);
+    for ( std::size_t i = 0; i < nstates; ++i ) {
+      std::vector<U>& col = M[i];
+      col.resize(nstates);
+      for ( std::size_t j = 0; j < nstates; ++j )
+        col[j] = elnproduct(transition[i][j], emission[j][observed[first]]);
+
+      for ( std::size_t s = first+1; s < last; ++s ) {
+        lcl.assign(col.begin(), col.end());
+        step_forward(MaxPlusRing<U>(), Span(nstates), Span(nstates), transition,
+                     [&](std::size_t k) { return(lcl[k]); },
+                     [&](std::size_t j, U v) { col[j] = v; },
+                     [&](std::size_t j) { return(emission[j][observed[s]]); });
+      } // for
+    } // for
+  }
+
+} // namespace details
+
+  //================
+  // forward_scan()
+  //  : alphas[c] is alpha at the last position of chunk c; alphas.back()
+  //      is forward_index(..., observed.size(), ...)
+  //  : uses up to nchunks threads; fewer for short inputs
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename L = exact_logsum>
+  void forward_scan(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    std::size_t nchunks,
+                    std::vector< std::vector<U> >& alphas,
+                    L lsum = L()) {
+    const std::size_t nobs = observed.size();
+    const std::size_t nstates = initial.size();
+    alphas.clear();
+    if ( 0 == nobs )
+      return;
+
+    const std::vector<std::size_t> bounds = details::chunk_bounds(nobs, nchunks, nstates);
+    nchunks = bounds.size() - 1;
+
+    std::vector< std::vector< std::vector<U> > > M(nchunks);
+    alphas.assign(nchunks, std::vector<U>(nstates, 0));
+    std::vector<std::thread> threads;
+    for ( std::size_t c = 1; c < nchunks; ++c ) {
+      threads.push_back(std::thread([&, c]() {
+        details::chunk_transfer(observed, transition, emission, bounds[c], bounds[c+1], M[c], lsum);
+      }));
+    } // for
+
+    Workspace<U> ws;
+    forward_index(observed, initial, transition, emission, bounds[1], alphas[0], ws, lsum);
+    for ( std::size_t c = 0; c < threads.size(); ++c )
+      threads[c].join();
+
+    // scan: alpha at the end of chunk c from the end of chunk c-1
+    U tmpf = inf<U>();
+    for ( std::size_t c = 1; c < nchunks; ++c ) {
+      for ( std::size_t j = 0; j < nstates; ++j ) {
+        tmpf = inf<U>();
+        for ( std::size_t i = 0; i < nstates; ++i )
+          tmpf = lsum(tmpf, elnproduct(alphas[c-1][i], M[c][i][j]));
+        alphas[c][j] = tmpf;
+      } // for
+    } // for
+  }
+
+  //==============
+  // evalp_scan()
+  //  : evalp() on up to nthreads threads
+  template <typename O, typename I, typename T, typename E,
+            typename L = exact_logsum>
+  float evalp_scan(const O& observed,
+                   const I& initial,
+                   const T& transition,
+                   const E& emission,
+                   std::size_t nthreads,
+                   L lsum = L()) {
+    if ( observed.size() < 2 )
+      return(inf<float>());
+
+    std::vector< std::vector<typename O::value_type> > alphas;
+    forward_scan(observed, initial, transition, emission, nthreads, alphas, lsum);
+    float enlp = inf<float>();
+    for ( std::size_t i = 0; i < alphas.back().size(); ++i )
+      enlp = lsum(enlp, alphas.back()[i]);
+    return(std::exp(enlp));
+  }
+
+  //================
+  // viterbi_scan()
+  //  : viterbi() on up to nthreads threads
+  //  : chunk 0 is written to out as it is decoded; later chunks are held
+  //      until every chunk before them has been written
+  template <typename O, typename I, typename T, typename E, typename OutIter>
+  void viterbi_scan(const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    OutIter out,
+                    std::size_t nthreads) {
+    typedef typename O::value_type U;
+    const std::size_t nobs = observed.size();
+    const std::size_t nstates = initial.size();
+    if ( 0 == nobs )
+      return;
+
+    const std::vector<std::size_t> bounds = details::chunk_bounds(nobs, nthreads, nstates);
+    const std::size_t nchunks = bounds.size() - 1;
+    if ( 1 == nchunks ) {
+      viterbi(observed, initial, transition, emission, out);
+      return;
+    }
+
+    // max-plus summaries of chunks 1..n-1 while chunk 0 is decoded
+    std::vector< std::vector< std::vector<U> > > M(nchunks);
+    std::vector<std::thread> threads;
+    for ( std::size_t c = 1; c < nchunks; ++c ) {
+      threads.push_back(std::thread([&, c]() {
+        details::chunk_transfer_maxplus(observed, transition, emission, bounds[c], bounds[c+1], M[c]);
+      }));
+    } // for
+
+    std::vector< std::vector<U> > deltas(nchunks, std::vector<U>(nstates, 0));
+    {
+      std::vector<U> delta[2] = { std::vector<U>(nstates), std::vector<U>(nstates) };
+      std::size_t index = 0;
+      for ( std::size_t i = 0; i < nstates; ++i ) {
+        delta[0][i] = elnproduct(initial[i], emission[i][observed[0]]);
+        if ( elngreater(delta[0][i], delta[0][index]) )
+          index = i;
+      } // for
+      *out++ = index;
+      std::size_t active = 0;
+      details::viterbi_steps(observed, transition, emission, 1, bounds[1], delta, active, out);
+      deltas[0].swap(delta[active]);
+    }
+    for ( std::size_t c = 0; c < threads.size(); ++c )
+      threads[c].join();
+    threads.clear();
+
+    // scan: delta at the end of chunk c from the end of chunk c-1
+    for ( std::size_t c = 1; c < nchunks; ++c ) {
+      for ( std::size_t j = 0; j < nstates; ++j ) {
+        U mx = elnproduct(deltas[c-1][0], M[c][0][j]), tmp = mx;
+        for ( std::size_t i = 1; i < nstates; ++i ) {
+          tmp = elnproduct(deltas[c-1][i], M[c][i][j]);
+          if ( elngreater(tmp, mx) )
+            mx = tmp;
+        } // for
+        deltas[c][j] = mx;
+      } // for
+      std::vector< std::vector<U> >().swap(M[c]);
+    } // for
+
+    // re-run each chunk from its entry delta
+    std::vector< std::vector<std::uint32_t> > paths(nchunks);
+    for ( std::size_t c = 1; c < nchunks; ++c ) {
+      threads.push_back(std::thread([&, c]() {
+        std::vector<U> delta[2] = { deltas[c-1], std::vector<U>(nstates) };
+        std::size_t active = 0;
+        paths[c].reserve(bounds[c+1] - bounds[c]);
+        auto path = std::back_inserter(paths[c]);
+        details::viterbi_steps(observed, transition, emission, bounds[c], bounds[c+1], delta, active, path);
+      }));
+    } // for
+
+    for ( std::size_t c = 1; c < nchunks; ++c ) {
+      threads[c-1].join();
+      for ( std::size_t s = 0; s < paths[c].size(); ++s )
+        *out++ = static_cast<std::size_t>(paths[c][s]);
+      std::vector<std::uint32_t>().swap(paths[c]);
+    } // for
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // SCAN_HMM_R_HPP
@@ -0,0 +1,403 @@
+/*
+  FILE: serve.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Mon Oct 19 01:47:05 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef SERVE_HMM_R_HPP
+#define SERVE_HMM_R_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ---------------------
+    Serving
+    ---------------------
+    A Server reads requests, one per line, from stdin or from clients of a
+      Unix domain socket, and answers each with the single line returned by
+      a caller-supplied handler.  Handlers run on a fixed pool of worker
+      threads, so requests are answered concurrently and possibly out of
+      order; the protocol layered on top is expected to carry a request id.
+      A connection stays open until its client closes it and every response
+      it is owed has been written.  Each client has a reader thread, joined
+      at the next accept after it finishes, so a long-running Listen()
+      holds threads only for clients still connected.  A request longer than
+      maxline bytes is not queued; the rest of its line is discarded and the
+      client gets the single line returned by an Overlong callback, given
+      the first maxline bytes, instead.
+
+    LatencyHistogram counts handler times in power-of-two microsecond
+      buckets; Record() is lock-free, so workers share one histogram.
+  */
+
+  //===================
+  // LatencyHistogram
+  //   : bucket 0 is under 1 microsecond; bucket b > 0 is [2^(b-1), 2^b)
+  class LatencyHistogram {
+  public:
+    static constexpr std::size_t NBuckets = 40;
+
+    LatencyHistogram()
+      { for ( auto& b : buckets_ ) b = 0; }
+
+    inline void Record(std::chrono::steady_clock::duration d) {
+      const auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+      std::size_t b = 0;
+      for ( auto v = us; v > 0 && b + 1 < NBuckets; v >>= 1 )
+        ++b;
+      buckets_[b].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t Count() const {
+      std::uint64_t n = 0;
+      for ( auto& b : buckets_ )
+        n += b.load(std::memory_order_relaxed);
+      return(n);
+    }
+
+    //============
+    // Quantile()
+    //  : upper bound in microseconds of the bucket holding quantile q
+    std::uint64_t Quantile(double q) const {
+      const std::uint64_t n = Count();
+      std::uint64_t seen = 0;
+      for ( std::size_t b = 0; b < NBuckets; ++b ) {
+        seen += buckets_[b].load(std::memory_order_relaxed);
+        if ( n > 0 && seen >= q * n )
+          return(Upper(b));
+      } // for
+      return(0);
+    }
+
+    // one line per non-empty bucket: <from-us> <to-us> <count>
+    void Write(std::ostream& os, const std::string& prefix) const {
+      for ( std::size_t b = 0; b < NBuckets; ++b ) {
+        const std::uint64_t c = buckets_[b].load(std::memory_order_relaxed);
+        if ( c > 0 )
+          os << prefix << "\t" << (b ? Upper(b-1) : 0) << "\t" << Upper(b) << "\t" << c << "\n";
+      } // for
+    }
+
+    static inline std::uint64_t Upper(std::size_t b)
+      { return(std::uint64_t(1) << b); }
+
+  private:
+    LatencyHistogram(const LatencyHistogram&); // disabled purposefully
+    void operator=(const LatencyHistogram&); // disabled purposefully
+
+    std::array<std::atomic<std::uint64_t>, NBuckets> buckets_;
+  };
+
+  //=========
+  // Server
+  //   : Handler(worker, request) returns the response line, without '\n';
+  //       worker is in [0, nthreads) and never runs two requests at once
+  //   : Handler must not throw; report errors in the response
+  //   : Serve() and Listen() return once every accepted request is answered
+  //   : Overlong(head) returns the response to a request over maxline bytes
+  class Server {
+  public:
+    typedef std::function<std::string(std::size_t, const std::string&)> Handler;
+    typedef std::function<std::string(const std::string&)> Overlong;
+    static constexpr std::size_t MaxQueued = 1024; // readers block beyond this
+    static constexpr std::size_t MaxLine = std::size_t(1) << 26; // bytes in one request, by default
+
+    Server(Handler handler, std::size_t nthreads, std::size_t maxline = MaxLine, Overlong overlong = Overlong())
+          : handler_(handler), overlong_(overlong), maxline_(std::max<std::size_t>(1, maxline)),
+            listen_(-1), stopped_(false), done_(false), busy_(0) {
+      if ( !overlong_ ) {
+        const std::string why = "error\trequest longer than " + std::to_string(maxline_) + " bytes";
+        overlong_ = [why](const std::string&) { return(why); };
+      }
+      for ( std::size_t w = 0; w < std::max<std::size_t>(1, nthreads); ++w )
+        workers_.push_back(std::thread(&Server::work, this, w));
+    }
+
+    ~Server() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+      }
+      ready_.notify_all();
+      for ( auto& w : workers_ )
+        w.join();
+    }
+
+    //=========
+    // Serve()
+    //  : requests from fd in, responses to fd out, until end of input
+    void Serve(int in, int out) {
+      auto conn = std::make_shared<Connection>(in, out, false);
+      read(conn);
+      conn->Drain();
+    }
+
+    //==========
+    // Listen()
+    //  : accepts clients on a Unix domain socket at path until Stop()
+    void Listen(const std::string& path) {
+      sockaddr_un addr;
+      std::memset(&addr, 0, sizeof(addr));
+      addr.sun_family = AF_UNIX;
+      if ( path.size() >= sizeof(addr.sun_path) )
+        throw("Socket path too long: " + path);
+      std::strcpy(addr.sun_path, path.c_str());
+      const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      if ( fd < 0 || ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 64) != 0 ) {
+        const std::string why = std::strerror(errno);
+        if ( fd >= 0 )
+          ::close(fd);
+        throw("Cannot listen on " + path + ": " + why);
+      }
+      listen_ = fd;
+
+      std::map<std::thread::id, std::thread> readers;
+      while ( !stopped_ ) {
+        const int client = ::accept(fd, nullptr, nullptr);
+        reap(readers);
+        if ( client < 0 ) {
+          if ( errno == EINTR || errno == ECONNABORTED )
+            continue;
+          if ( errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM ) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100)); // until clients close
+            continue;
+          }
+          break; // Stop() shut the socket down
+        }
+        auto conn = std::make_shared<Connection>(client, client, true);
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          open_.insert(conn.get());
+        }
+        std::thread reader([this, conn]() {
+          read(conn);
+          std::lock_guard<std::mutex> lock(mutex_);
+          open_.erase(conn.get());
+          finished_.push_back(std::this_thread::get_id());
+        });
+        readers[reader.get_id()] = std::move(reader);
+      } // while
+
+      { // end reads on clients still connected; their queued requests are still answered
+        std::lock_guard<std::mutex> lock(mutex_);
+        for ( auto c : open_ )
+          ::shutdown(c->In(), SHUT_RD);
+      }
+      for ( auto& r : readers )
+        r.second.join();
+      finished_.clear();
+      listen_ = -1;
+      ::close(fd);
+      ::unlink(path.c_str());
+      std::unique_lock<std::mutex> lock(mutex_);
+      idle_.wait(lock, [this] { return(queue_.empty() && 0 == busy_); });
+    }
+
+    //========
+    // Stop()
+    //  : ends Listen(); async-signal-safe
+    inline void Stop() {
+      stopped_ = true;
+      const int fd = listen_;
+      if ( fd >= 0 )
+        ::shutdown(fd, SHUT_RDWR);
+    }
+
+  private:
+    Server(const Server&); // disabled purposefully
+    void operator=(const Server&); // disabled purposefully
+
+    // one client; closed once its reader and all of its responses are done
+    class Connection {
+    public:
+      Connection(int in, int out, bool owns) : in_(in), out_(out), owns_(owns), pending_(0)
+        { }
+
+      ~Connection() {
+        if ( owns_ )
+          ::close(in_);
+      }
+
+      inline int In() const { return(in_); }
+
+      inline void Expect() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++pending_;
+      }
+
+      void Respond(std::string s) {
+        s += '\n';
+        std::lock_guard<std::mutex> lock(mutex_);
+        for ( std::size_t sent = 0; sent < s.size(); ) {
+          const ssize_t n = owns_ ? ::send(out_, s.data() + sent, s.size() - sent, MSG_NOSIGNAL)
+                                  : ::write(out_, s.data() + sent, s.size() - sent);
+          if ( n < 0 && errno == EINTR )
+            continue;
+          if ( n <= 0 )
+            break; // client went away; drop the response
+          sent += n;
+        } // for
+        --pending_;
+        drained_.notify_all();
+      }
+
+      void Drain() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        drained_.wait(lock, [this] { return(0 == pending_); });
+      }
+
+    private:
+      const int in_, out_;
+      const bool owns_;
+      std::size_t pending_;
+      std::mutex mutex_;
+      std::condition_variable drained_;
+    };
+
+    struct Job {
+      std::shared_ptr<Connection> conn;
+      std::string request;
+    };
+
+    // queue each complete line of conn's input; answer overlong lines here
+    void read(const std::shared_ptr<Connection>& conn) {
+      std::vector<char> buf(1 << 16);
+      std::string line;
+      bool skip = false; // discarding the rest of an overlong line
+      while ( true ) {
+        const ssize_t n = ::read(conn->In(), buf.data(), buf.size());
+        if ( n < 0 && errno == EINTR )
+          continue;
+        if ( n <= 0 )
+          break;
+        for ( ssize_t i = 0; i < n; ++i ) {
+          if ( buf[i] == '\n' ) {
+            if ( !line.empty() )
+              push(conn, line);
+            line.clear();
+            skip = false;
+          } else if ( skip ) {
+            continue;
+          } else if ( line.size() == maxline_ ) {
+            conn->Expect();
+            conn->Respond(overlong_(line));
+            line.clear();
+            skip = true;
+          } else {
+            line += buf[i];
+          }
+        } // for
+      } // while
+      if ( !line.empty() )
+        push(conn, line);
+    }
+
+    // join readers that have finished since the last call
+    void reap(std::map<std::thread::id, std::thread>& readers) {
+      std::vector<std::thread::id> done;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done.swap(finished_);
+      }
+      for ( auto id : done ) {
+        auto r = readers.find(id);
+        r->second.join();
+        readers.erase(r);
+      } // for
+    }
+
+    void push(const std::shared_ptr<Connection>& conn, const std::string& request) {
+      conn->Expect();
+      std::unique_lock<std::mutex> lock(mutex_);
+      room_.wait(lock, [this] { return(queue_.size() < MaxQueued); });
+      queue_.push_back(Job{conn, request});
+      lock.unlock();
+      ready_.notify_one();
+    }
+
+    void work(std::size_t w) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while ( true ) {
+        ready_.wait(lock, [this] { return(!queue_.empty() || done_); });
+        if ( queue_.empty() )
+          return;
+        Job job = std::move(queue_.front());
+        queue_.pop_front();
+        ++busy_;
+        lock.unlock();
+        room_.notify_one();
+        job.conn->Respond(handler_(w, job.request));
+        job.conn.reset();
+        lock.lock();
+        --busy_;
+        if ( queue_.empty() && 0 == busy_ )
+          idle_.notify_all();
+      } // while
+    }
+
+  private:
+    Handler handler_;
+    Overlong overlong_;
+    const std::size_t maxline_;
+    std::atomic<int> listen_;
+    std::atomic<bool> stopped_;
+    bool done_;
+    std::size_t busy_;
+    std::deque<Job> queue_;
+    std::set<Connection*> open_;
+    std::vector<std::thread::id> finished_; // readers done but not yet joined
+    std::mutex mutex_;
+    std::condition_variable ready_, room_, idle_;
+    std::vector<std::thread> workers_; // last: start running during construction
+  };
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // SERVE_HMM_R_HPP
@@ -0,0 +1,214 @@
+/*
+  FILE: sparse.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 22:31:09 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef SPARSE_HMM_R_HPP
+#define SPARSE_HMM_R_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "efun.hpp"
+#include "infinity.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ------------------
+    Sparse emissions
+    ------------------
+    A SparseRow<> is one state's emission log-probabilities over an
+      alphabet of size() symbols, storing only the symbols given a value
+      of their own in sorted arrays.  Every other symbol scores Floor(),
+      log-zero by default.  A std::vector< SparseRow<U> > stands in for
+      the usual [state][symbol] emission matrix: the kernels read
+      emission[j][symbol] and emission[0].size() as before, at the cost
+      of a binary search over the symbols the state emits.
+
+    Memory is proportional to the (state, symbol) pairs actually stored.
+      With a log-zero floor, the per-symbol emitter lists (workspace.hpp)
+      come from the stored entries alone, and mstep() keeps only symbols
+      with expected counts.  A finite floor scores unseen symbols without
+      storing them; it is left as is by re-estimation and is not part of
+      a row's normalization.
+
+    The fixed-size kernels lay out a dense [symbol][state] copy of the
+      model, so the *_auto() versions use the generic kernels for sparse
+      rows.  train_mem() accumulates into emission itself and needs dense
+      rows.
+  */
+
+  //=============
+  // SparseRow<>
+  template <typename U>
+  struct SparseRow {
+    typedef U value_type;
+
+    explicit SparseRow(std::size_t nsymbols = 0, U floor = inf<U>())
+      : size_(nsymbols), floor_(floor)
+      { }
+
+    inline std::size_t size() const { return(size_); }
+    inline U Floor() const { return(floor_); }
+
+    //==============
+    // operator[]()
+    inline U operator[](std::size_t symbol) const {
+      const std::uint32_t key = static_cast<std::uint32_t>(symbol);
+      auto iter = std::lower_bound(symbols_.begin(), symbols_.end(), key);
+      if ( iter == symbols_.end() || *iter != key )
+        return(floor_);
+      return(values_[iter - symbols_.begin()]);
+    }
+
+    //=========
+    // Set()
+    //  : cheapest in increasing symbol order
+    void Set(std::size_t symbol, U value) {
+      const std::uint32_t key = static_cast<std::uint32_t>(symbol);
+      if ( symbols_.empty() || symbols_.back() < key ) {
+        symbols_.push_back(key), values_.push_back(value);
+        return;
+      }
+      auto iter = std::lower_bound(symbols_.begin(), symbols_.end(), key);
+      const std::size_t k = iter - symbols_.begin();
+      if ( *iter == key )
+        values_[k] = value;
+      else
+        symbols_.insert(iter, key), values_.insert(values_.begin() + k, value);
+    }
+
+    //===========
+    // Assign()
+    //  : drop all stored symbols; keeps capacity
+    void Assign(std::size_t nsymbols, U floor) {
+      size_ = nsymbols, floor_ = floor;
+      symbols_.clear(), values_.clear();
+    }
+
+    //===========================
+    // Stored(), Symbol(), Value()
+    //  : the k-th stored symbol and its value, in increasing symbol order
+    inline std::size_t Stored() const { return(symbols_.size()); }
+    inline std::size_t Symbol(std::size_t k) const { return(symbols_[k]); }
+    inline U Value(std::size_t k) const { return(values_[k]); }
+
+  private:
+    std::size_t size_;
+    U floor_;
+    std::vector<std::uint32_t> symbols_;
+    std::vector<U> values_;
+  };
+
+namespace details {
+
+  template <typename E>
+  struct sparse_rows : std::false_type {};
+
+  template <typename U>
+  struct sparse_rows< std::vector< SparseRow<U> > > : std::true_type {};
+
+  //===========
+  // emitted()
+  //  : f(m) for each symbol m that row does not score as log-zero
+  template <typename R, typename F>
+  inline void emitted(const R& row, F f) {
+    typedef typename R::value_type U;
+    for ( std::size_t m = 0; m < row.size(); ++m ) {
+      if ( row[m] != inf<U>() )
+        f(m);
+    } // for
+  }
+
+  template <typename U, typename F>
+  inline void emitted(const SparseRow<U>& row, F f) {
+    if ( row.Floor() == inf<U>() ) { // stored symbols only
+      for ( std::size_t k = 0; k < row.Stored(); ++k ) {
+        if ( row.Value(k) != inf<U>() )
+          f(row.Symbol(k));
+      } // for
+      return;
+    }
+
+    std::size_t k = 0;
+    for ( std::size_t m = 0; m < row.size(); ++m ) {
+      if ( k < row.Stored() && row.Symbol(k) == m ) {
+        if ( row.Value(k++) != inf<U>() )
+          f(m);
+      }
+      else
+        f(m);
+    } // for
+  }
+
+  //=============
+  // log_zeros()
+  //  : true if some state scores some symbol as log-zero
+  template <typename E>
+  inline bool log_zeros(const E& emission) {
+    for ( std::size_t j = 0; j < emission.size(); ++j ) {
+      std::size_t n = 0;
+      emitted(emission[j], [&](std::size_t) { ++n; });
+      if ( n < emission[j].size() )
+        return(true);
+    } // for
+    return(false);
+  }
+
+  //===================
+  // update_emission()
+  //  : row j of emission from numeratorE ([symbol][state], rows left
+  //      empty for symbols never seen) and state j's denominator
+  template <typename R, typename U>
+  inline void update_emission(R& row, const std::vector< std::vector<U> >& numeratorE,
+                              std::size_t j, U denominator) {
+    for ( std::size_t i = 0; i < numeratorE.size(); ++i )
+      row[i] = numeratorE[i].empty() ? inf<U>() : elnproduct(numeratorE[i][j], -denominator);
+  }
+
+  template <typename U>
+  inline void update_emission(SparseRow<U>& row, const std::vector< std::vector<U> >& numeratorE,
+                              std::size_t j, U denominator) {
+    row.Assign(numeratorE.size(), row.Floor());
+    for ( std::size_t i = 0; i < numeratorE.size(); ++i ) {
+      if ( numeratorE[i].empty() )
+        continue;
+      const U value = elnproduct(numeratorE[i][j], -denominator);
+      if ( value != inf<U>() )
+        row.Set(i, value);
+    } // for
+  }
+
+} // namespace details
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // SPARSE_HMM_R_HPP
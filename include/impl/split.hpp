@@ -0,0 +1,275 @@
+/*
+  FILE: split.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Mon Oct 19 03:20:44 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef SPLIT_HMM_R_HPP
+#define SPLIT_HMM_R_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "efun.hpp"
+#include "fixed.hpp"
+#include "infinity.hpp"
+#include "logsum.hpp"
+#include "sparse.hpp"
+#include "stats.hpp"
+#include "step.hpp"
+#include "train.hpp"
+#include "workspace.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ------------------
+    Two-thread E-step
+    ------------------
+    estep() sweeps beta backward over the whole sequence, then alpha
+      forward, one after the other.  estep_split() cuts the sequence at
+      m = T/2 and gives each half's sweep to its own thread:
+        phase 1: F runs alpha over [0, m), keeping alpha at the first
+                 position of each segment; B runs beta back over [m, T),
+                 keeping beta at the last position of each segment
+        phase 2: F carries alpha on through [m, T), recomputing one
+                 segment of betas at a time from B's checkpoints, and
+                 accumulates gamma and xi there; B carries beta back
+                 through [0, m), recomputing one segment of alphas at a
+                 time from F's checkpoints, and accumulates there
+      Each thread makes one and a half sweeps and half of the gamma and xi
+      work.  Segments are BackCache<>'s length, so memory is that of
+      estep() plus one more segment.
+
+    Every alpha, beta, gamma and xi is the value estep() computes.  The
+      two halves are summed separately and then merged, so statistics
+      match estep() up to rounding in those sums (about 4e-4 in log space
+      over 20000 observations), not bit for bit.  Matching estep()'s order
+      would mean summing [0, m) forward in time before [m, T) could start,
+      and B walks [0, m) backward, so it would take either a trellis of
+      gammas and xis for [0, m) or one thread waiting on the other.  The
+      result does not depend on thread timing.
+  */
+
+namespace details {
+
+  //================
+  // estep_halves()
+  //  : estep_split() over states in all (Span or FixedSpan<>)
+  template <typename S, typename O, typename I, typename T, typename E, typename U, typename P>
+  void estep_halves(const S& all,
+                    const O& observed,
+                    const I& initial,
+                    const T& transition,
+                    const E& emission,
+                    Statistics<U>& stats,
+                    Workspace<U>& ws,
+                    P) {
+    const std::size_t nobs = observed.size(), n = initial.size(), mid = nobs / 2;
+    const typename P::forward_type lfwd = typename P::forward_type();
+    const typename P::xi_type lxi = typename P::xi_type();
+    const typename P::accumulate_type lacc = typename P::accumulate_type();
+    const LogRing<U, typename P::forward_type> fring(lfwd);
+    const LogRing<U, typename P::backward_type> bring((typename P::backward_type()));
+
+    const std::size_t sz = std::max(static_cast<std::size_t>(10000),
+                                    static_cast<std::size_t>(std::sqrt(nobs)));
+    const std::size_t nsegF = (mid + sz - 1) / sz, nsegB = (nobs - mid + sz - 1) / sz;
+    ws.flat.resize((nsegF + nsegB + 2 * std::min(sz, nobs) + 2 * (3 + n)) * n);
+    U* const marksF = ws.flat.data();                  // alpha at the first position of each segment of [0, mid)
+    U* const marksB = marksF + nsegF * n;              // beta at the last position of each segment of [mid, nobs)
+    U* const bufF = marksB + nsegB * n;                // F: betas of one segment of [mid, nobs)
+    U* const bufB = bufF + std::min(sz, nobs) * n;     // B: alphas of one segment of [0, mid)
+    U* const colsF = bufB + std::min(sz, nobs) * n;    // F: two alpha columns, gamma, xi
+    U* const colsB = colsF + (3 + n) * n;              // B: two beta columns, gamma, xi
+
+    auto sym = [&](std::size_t s) { return(static_cast<std::size_t>(observed[s])); };
+    auto forward = [&](std::size_t s, const U* prev, U* next) { // alpha(s) from alpha(s-1)
+      const std::size_t m = sym(s);
+      step_forward(fring, all, all, transition,
+                   [&](std::size_t k) { return(prev[k]); },
+                   [&](std::size_t j, U v) { next[j] = v; },
+                   [&](std::size_t j) { return(emission[j][m]); });
+    };
+    auto backward = [&](std::size_t s, const U* next, U* prev) { // beta(s-1) from beta(s)
+      const std::size_t m = sym(s);
+      step_backward(bring, all, all, transition,
+                    [&](std::size_t k) { return(next[k]); },
+                    [&](std::size_t j, U v) { prev[j] = v; },
+                    [&](std::size_t k) { return(emission[k][m]); });
+    };
+    auto gamma = [&](std::size_t s, const U* alpha, const U* beta, U* gam, Statistics<U>& st) {
+      U normalizer = inf<U>();
+      for ( std::size_t i : all ) {
+        gam[i] = elnproduct(alpha[i], beta[i]);
+        normalizer = lfwd(normalizer, gam[i]);
+      } // for
+      for ( std::size_t j : all )
+        gam[j] = elnproduct(gam[j], -normalizer);
+
+      std::vector<U>& numE = st.Symbol(sym(s));
+      for ( std::size_t j : all ) {
+        numE[j] = lacc(numE[j], gam[j]);
+        st.denominator[j] = lacc(st.denominator[j], gam[j]);
+      } // for
+      if ( 0 == s ) {
+        for ( std::size_t y : all )
+          st.initial[y] = lacc(st.initial[y], gam[y]);
+        st.loglik += normalizer;
+        ++st.nsequences;
+      }
+    };
+    auto xi = [&](std::size_t s, const U* alpha, const U* beta, U* probs, Statistics<U>& st) { // alpha(s-1), beta(s)
+      const std::size_t m = sym(s);
+      U normalizer = inf<U>();
+      for ( std::size_t i : all ) {
+        for ( std::size_t j : all ) {
+          probs[i * n + j] = elnproduct(alpha[i], elnproduct(transition[i][j], elnproduct(emission[j][m], beta[j])));
+          normalizer = lxi(normalizer, probs[i * n + j]);
+        } // for
+      } // for
+      for ( std::size_t i : all )
+        for ( std::size_t j : all )
+          st.numeratorT[i][j] = lacc(st.numeratorT[i][j], elnproduct(probs[i * n + j], -normalizer));
+    };
+
+    // phase 1: F forward over [0, mid); B backward over [mid, nobs)
+    U* alpha[2] = { colsF, colsF + n };
+    U* beta[2] = { colsB, colsB + n };
+    std::thread helper([&]() {
+      std::fill(beta[0], beta[0] + n, static_cast<U>(0));
+      for ( std::size_t s = nobs-1; ; --s ) {
+        if ( s+1 == nobs || (s - mid) % sz == sz-1 )
+          std::copy(beta[0], beta[0] + n, marksB + ((s - mid) / sz) * n);
+        if ( s == mid )
+          break;
+        backward(s, beta[0], beta[1]);
+        std::swap(beta[0], beta[1]);
+      } // for
+    });
+    for ( std::size_t i : all )
+      alpha[0][i] = elnproduct(initial[i], emission[i][sym(0)]);
+    for ( std::size_t s = 0; s < mid; ++s ) {
+      if ( s > 0 ) {
+        forward(s, alpha[0], alpha[1]);
+        std::swap(alpha[0], alpha[1]);
+      }
+      if ( s % sz == 0 )
+        std::copy(alpha[0], alpha[0] + n, marksF + (s / sz) * n);
+    } // for
+    helper.join();
+
+    // phase 2: F on through [mid, nobs) into ws.half; B back through [0, mid) into stats
+    Statistics<U>& half = ws.half;
+    half.Reset(stats.NStates(), stats.NSymbols());
+    helper = std::thread([&]() {
+      U* const gam = colsB + 2 * n;
+      U* const probs = colsB + 3 * n;
+      for ( std::size_t g = nsegF; g-- > 0; ) {
+        const std::size_t a = g * sz, b = std::min(a + sz, mid);
+        std::copy(marksF + g * n, marksF + (g+1) * n, bufB);
+        for ( std::size_t s = a+1; s < b; ++s )
+          forward(s, bufB + (s-1-a) * n, bufB + (s-a) * n);
+        for ( std::size_t s = b; s-- > a; ) {
+          const U* alpha_s = bufB + (s-a) * n;
+          backward(s+1, beta[0], beta[1]); // beta[0] is beta(s+1)
+          if ( s+1 < mid )
+            xi(s+1, alpha_s, beta[0], probs, stats);
+          std::swap(beta[0], beta[1]);
+          gamma(s, alpha_s, beta[0], gam, stats);
+        } // for
+      } // for
+    });
+    U* const gam = colsF + 2 * n;
+    U* const probs = colsF + 3 * n;
+    for ( std::size_t g = 0; g < nsegB; ++g ) {
+      const std::size_t a = mid + g * sz, b = std::min(a + sz, nobs);
+      std::copy(marksB + g * n, marksB + (g+1) * n, bufF + (b-1-a) * n);
+      for ( std::size_t s = b-1; s > a; --s )
+        backward(s, bufF + (s-a) * n, bufF + (s-1-a) * n);
+      for ( std::size_t s = a; s < b; ++s ) {
+        const U* beta_s = bufF + (s-a) * n;
+        xi(s, alpha[0], beta_s, probs, half);
+        forward(s, alpha[0], alpha[1]);
+        std::swap(alpha[0], alpha[1]);
+        if ( s+1 < nobs )
+          gamma(s, alpha[0], beta_s, gam, half);
+      } // for
+    } // for
+    helper.join();
+    stats.Merge(half);
+  }
+
+} // namespace details
+
+  //===============
+  // estep_split()
+  //  : estep() on two threads; same statistics up to rounding
+  //  : fixed-size kernels for 2 to 16 states; estep_auto() for sparse
+  //      emission rows and sequences under 4 observations
+  //  : scratch comes from ws.flat and ws.half
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void estep_split(const O& observed,
+                   const I& initial,
+                   const T& transition,
+                   const E& emission,
+                   Statistics<U>& stats,
+                   Workspace<U>& ws,
+                   P policy = P()) {
+    if ( details::sparse_rows<E>::value || observed.size() < 4 ) {
+      estep_auto(observed, initial, transition, emission, stats, ws, policy);
+      return;
+    }
+    auto f = [&](auto n) {
+      details::estep_halves(details::FixedSpan<decltype(n)::value>(), observed, initial, transition, emission, stats, ws, policy);
+    };
+    if ( !dispatch_states(initial.size(), f) )
+      details::estep_halves(details::Span(initial.size()), observed, initial, transition, emission, stats, ws, policy);
+  }
+
+  //===============
+  // train_split()
+  //  : estep_split() followed by mstep()
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void train_split(const O& observed,
+                   I& initial,
+                   T& transition,
+                   E& emission,
+                   Workspace<U>& ws,
+                   P policy = P()) {
+    ws.stats.Reset(initial.size(), emission[0].size());
+    estep_split(observed, initial, transition, emission, ws.stats, ws, policy);
+    mstep(ws.stats, initial, transition, emission);
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // SPLIT_HMM_R_HPP
@@ -0,0 +1,222 @@
+/*
+  FILE: stats.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 12:31:09 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef STATS_HMM_R_HPP
+#define STATS_HMM_R_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "efun.hpp"
+#include "infinity.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  //===============
+  // Statistics<>
+  //   : Baum-Welch sufficient statistics in log space, as accumulated by
+  //       estep() and consumed by mstep()
+  //   : Statistics from independent sequences (or shards of work) combine
+  //       with Merge(); the merged result re-estimates a model exactly as
+  //       if the accumulations had been done in one place
+  //   : Layout follows train(): numeratorT is [from][to], numeratorE is
+  //       [symbol][state]; both share the per-state denominator, the
+  //       summed gammas over all but the last position
+  //   : A numeratorE row stays empty (all log-zero) until Symbol() is
+  //       first called for it, so memory follows the symbols observed
+  template <typename U>
+  struct Statistics {
+
+    //=============
+    // Constructor
+    Statistics(std::size_t nstates = 0, std::size_t nsymbols = 0)
+      { Reset(nstates, nsymbols); }
+
+    //=========
+    // Reset()
+    void Reset(std::size_t nstates, std::size_t nsymbols) {
+      nsequences = 0;
+      loglik = 0;
+      initial.assign(nstates, inf<U>());
+      denominator.assign(nstates, inf<U>());
+      reset(numeratorT, nstates, nstates);
+      numeratorE.resize(nsymbols);
+      for ( std::size_t i = 0; i < nsymbols; ++i ) {
+        if ( !numeratorE[i].empty() ) // keep rows from earlier use allocated
+          numeratorE[i].assign(nstates, inf<U>());
+      } // for
+    }
+
+    //==========
+    // Symbol()
+    //  : numeratorE row for symbol m, allocated on first use
+    inline std::vector<U>& Symbol(std::size_t m) {
+      std::vector<U>& row = numeratorE[m];
+      if ( row.empty() )
+        row.assign(initial.size(), inf<U>());
+      return(row);
+    }
+
+    //=========
+    // Merge()
+    //  : caller guarantees matching dimensions
+    void Merge(const Statistics& s) {
+      nsequences += s.nsequences;
+      loglik += s.loglik;
+      merge(initial, s.initial);
+      merge(denominator, s.denominator);
+      merge(numeratorT, s.numeratorT);
+      for ( std::size_t m = 0; m < s.numeratorE.size(); ++m ) {
+        if ( !s.numeratorE[m].empty() )
+          merge(Symbol(m), s.numeratorE[m]);
+      } // for
+    }
+
+    std::size_t NStates() const
+      { return(initial.size()); }
+
+    std::size_t NSymbols() const
+      { return(numeratorE.size()); }
+
+    std::size_t nsequences;  // number of sequences accumulated
+    double loglik;           // sum of log P(O) over those sequences
+    std::vector<U> initial;  // gamma at the first position
+    std::vector<U> denominator;
+    std::vector< std::vector<U> > numeratorT, numeratorE;
+
+  private:
+    static void reset(std::vector< std::vector<U> >& a, std::size_t rows, std::size_t cols) {
+      a.resize(rows);
+      for ( std::size_t i = 0; i < rows; ++i )
+        a[i].assign(cols, inf<U>());
+    }
+
+    static void merge(std::vector<U>& a, const std::vector<U>& b) {
+      for ( std::size_t i = 0; i < a.size(); ++i )
+        a[i] = elnsum(a[i], b[i]);
+    }
+
+    static void merge(std::vector< std::vector<U> >& a, const std::vector< std::vector<U> >& b) {
+      for ( std::size_t i = 0; i < a.size(); ++i )
+        merge(a[i], b[i]);
+    }
+  };
+
+  /*
+    ----------------
+    Statistics files
+    ----------------
+    write_statistics() and read_statistics() keep a Statistics<> in a
+      binary file, as estep writes and mstep reads them:
+        "rHMM-Statistics", uint32 version, uint32 sizeof(U),
+        uint64 nstates, nsymbols, nsequences, double loglik,
+        initial, denominator and numeratorT (row by row) as U,
+        uint64 count of allocated numeratorE rows, then <uint64 symbol>
+        <row> for each
+      Values are native-endian; files move between machines of one kind.
+  */
+
+namespace details {
+  constexpr char StatsHeader[] = "rHMM-Statistics";
+  constexpr std::uint32_t StatsVersion = 3;
+} // namespace details
+
+  //====================
+  // write_statistics()
+  //  : throws a std::string if os fails
+  template <typename U>
+  void write_statistics(std::ostream& os, const Statistics<U>& stats) {
+    const std::string header(details::StatsHeader);
+    const std::uint32_t info[] = { details::StatsVersion, static_cast<std::uint32_t>(sizeof(U)) };
+    const std::uint64_t sizes[] = { stats.NStates(), stats.NSymbols(), stats.nsequences };
+    os.write(header.c_str(), header.size());
+    os.write(reinterpret_cast<const char*>(info), sizeof(info));
+    os.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+    os.write(reinterpret_cast<const char*>(&stats.loglik), sizeof(stats.loglik));
+    os.write(reinterpret_cast<const char*>(stats.initial.data()), sizeof(U) * stats.initial.size());
+    os.write(reinterpret_cast<const char*>(stats.denominator.data()), sizeof(U) * stats.denominator.size());
+    for ( auto& row : stats.numeratorT )
+      os.write(reinterpret_cast<const char*>(row.data()), sizeof(U) * row.size());
+    std::uint64_t nseen = 0; // emission numerators only for symbols seen: <symbol> <row>
+    for ( auto& row : stats.numeratorE )
+      nseen += !row.empty();
+    os.write(reinterpret_cast<const char*>(&nseen), sizeof(nseen));
+    for ( std::uint64_t m = 0; m < stats.numeratorE.size(); ++m ) {
+      if ( stats.numeratorE[m].empty() )
+        continue;
+      os.write(reinterpret_cast<const char*>(&m), sizeof(m));
+      os.write(reinterpret_cast<const char*>(stats.numeratorE[m].data()), sizeof(U) * stats.numeratorE[m].size());
+    } // for
+    if ( !os )
+      throw(std::string("Problem writing statistics"));
+  }
+
+  //===================
+  // read_statistics()
+  //  : stats gets the contents of is, which must hold exactly one file
+  //  : throws a std::string naming name if is is not a statistics file
+  //      of this version and value type, or is truncated
+  template <typename U>
+  void read_statistics(std::istream& is, Statistics<U>& stats, const std::string& name) {
+    std::string header(sizeof(details::StatsHeader) - 1, ' ');
+    std::uint32_t info[2] = { 0, 0 };
+    std::uint64_t sizes[3] = { 0, 0, 0 };
+    is.read(&header[0], header.size());
+    is.read(reinterpret_cast<char*>(info), sizeof(info));
+    is.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+    if ( !is || header != details::StatsHeader )
+      throw("Not an estep statistics file: " + name);
+    if ( info[0] != details::StatsVersion || info[1] != sizeof(U) )
+      throw("Incompatible statistics file version: " + name);
+
+    stats.Reset(sizes[0], sizes[1]);
+    stats.nsequences = sizes[2];
+    is.read(reinterpret_cast<char*>(&stats.loglik), sizeof(stats.loglik));
+    is.read(reinterpret_cast<char*>(stats.initial.data()), sizeof(U) * stats.initial.size());
+    is.read(reinterpret_cast<char*>(stats.denominator.data()), sizeof(U) * stats.denominator.size());
+    for ( auto& row : stats.numeratorT )
+      is.read(reinterpret_cast<char*>(row.data()), sizeof(U) * row.size());
+    std::uint64_t nseen = 0, m = 0;
+    is.read(reinterpret_cast<char*>(&nseen), sizeof(nseen));
+    for ( std::uint64_t k = 0; is && k < nseen; ++k ) {
+      if ( !is.read(reinterpret_cast<char*>(&m), sizeof(m)) || m >= stats.NSymbols() )
+        throw("Truncated or corrupt statistics file: " + name);
+      std::vector<U>& row = stats.Symbol(m);
+      is.read(reinterpret_cast<char*>(row.data()), sizeof(U) * row.size());
+    } // for
+    if ( !is || is.peek() != std::char_traits<char>::eof() )
+      throw("Truncated or corrupt statistics file: " + name);
+  }
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // STATS_HMM_R_HPP
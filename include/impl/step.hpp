@@ -0,0 +1,185 @@
+/*
+  FILE: step.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 23:47:52 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef STEP_HMM_R_HPP
+#define STEP_HMM_R_HPP
+
+#include <cstddef>
+#include <iterator>
+
+#include "efun.hpp"
+#include "infinity.hpp"
+#include "logsum.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ------------
+    Step kernel
+    ------------
+    Forward, backward and Viterbi advance one column with the same loop:
+      for each state j, combine with (+) the terms over predecessors (or
+      successors) k, each a (x) product of the other column, a transition
+      and possibly an emission.  Only the semiring differs:
+        LogRing<>     - (+) is a log-add policy (logsum.hpp); forward, backward
+        MaxPlusRing<> - (+) keeps the larger; Viterbi
+      Both use elnproduct() as (x) and log-zero as the empty sum.
+
+    step_forward() and step_backward() are that loop, once each.  Every
+      forward, backward and Viterbi kernel calls them, so a change to the
+      loop (vectorization, tiling) reaches all of them.  The state sets
+      are the layout, fixed at compile time:
+        Span         - all of 0..n-1
+        FixedSpan<N> - all of 0..N-1, with N a constant (fixed.hpp)
+        std::vector<std::size_t> - listed states, e.g. emitters or a beam
+      Columns are read and written through callables, so the same loop
+      serves a trellis row, a rolling vector or a raw array; writes to
+      states outside the target set are left to the caller.
+
+    Sums are seeded with their first term rather than folded onto
+      log-zero.  The log-add policies return the other operand exactly
+      when one side is log-zero, and MaxPlusRing<> ranks log-zero below
+      every finite value (elngreater()), so a term that is log-zero never
+      changes a sum.  Skipping such terms, as the emitter and beam state
+      lists do, leaves results unchanged bit for bit.
+  */
+
+namespace details {
+
+  //=============
+  // LogRing<>
+  template <typename U, typename L = exact_logsum>
+  struct LogRing {
+    typedef U value_type;
+
+    explicit LogRing(L lsum = L()) : lsum_(lsum)
+      { }
+
+    inline U Zero() const { return(inf<U>()); }
+    inline U Plus(U a, U b) const { return(lsum_(a, b)); }
+    inline U Times(U a, U b) const { return(elnproduct(a, b)); }
+
+  private:
+    L lsum_;
+  };
+
+  //=================
+  // MaxPlusRing<>
+  template <typename U>
+  struct MaxPlusRing {
+    typedef U value_type;
+
+    inline U Zero() const { return(inf<U>()); }
+    inline U Plus(U a, U b) const { return(elngreater(b, a) ? b : a); }
+    inline U Times(U a, U b) const { return(elnproduct(a, b)); }
+  };
+
+  //=================
+  // StateIterator
+  struct StateIterator {
+    explicit StateIterator(std::size_t i) : i_(i)
+      { }
+
+    inline std::size_t operator*() const { return(i_); }
+    inline StateIterator& operator++() { ++i_; return(*this); }
+    inline bool operator!=(const StateIterator& s) const { return(i_ != s.i_); }
+
+  private:
+    std::size_t i_;
+  };
+
+  //========
+  // Span
+  struct Span {
+    explicit Span(std::size_t n) : n_(n)
+      { }
+
+    inline StateIterator begin() const { return(StateIterator(0)); }
+    inline StateIterator end() const { return(StateIterator(n_)); }
+
+  private:
+    std::size_t n_;
+  };
+
+  //==============
+  // FixedSpan<>
+  template <std::size_t N>
+  struct FixedSpan {
+    inline StateIterator begin() const { return(StateIterator(0)); }
+    inline StateIterator end() const { return(StateIterator(N)); }
+  };
+
+  //==========
+  // fold()
+  //  : (+) of term(k) over k in from; Zero() when from is empty
+  template <typename R, typename S, typename F>
+  inline typename R::value_type fold(const R& ring, const S& from, F term) {
+    auto k = std::begin(from);
+    const auto last = std::end(from);
+    if ( !(k != last) )
+      return(ring.Zero());
+
+    typename R::value_type acc = term(*k);
+    for ( ++k; k != last; ++k )
+      acc = ring.Plus(acc, term(*k));
+    return(acc);
+  }
+
+  //================
+  // step_forward()
+  //  : for j in to, next(j, ((+)_k prev(k) (x) transition[k][j]) (x) emis(j))
+  //      with k in from
+  template <typename R, typename From, typename To, typename T,
+            typename P, typename N, typename M>
+  inline void step_forward(const R& ring, const From& from, const To& to,
+                           const T& transition, P prev, N next, M emis) {
+    typedef typename R::value_type U;
+    for ( std::size_t j : to ) {
+      const U acc = fold(ring, from, [&](std::size_t k) { return(ring.Times(prev(k), transition[k][j])); });
+      next(j, ring.Times(acc, emis(j)));
+    } // for
+  }
+
+  //=================
+  // step_backward()
+  //  : for j in to, prev(j, (+)_k transition[j][k] (x) (emis(k) (x) next(k)))
+  //      with k in from
+  template <typename R, typename From, typename To, typename T,
+            typename N, typename P, typename M>
+  inline void step_backward(const R& ring, const From& from, const To& to,
+                            const T& transition, N next, P prev, M emis) {
+    for ( std::size_t j : to )
+      prev(j, fold(ring, from, [&](std::size_t k) { return(ring.Times(transition[j][k], ring.Times(emis(k), next(k)))); }));
+  }
+
+} // namespace details
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // STEP_HMM_R_HPP
@@ -33,6 +33,10 @@
 #include "efun.hpp"
 #include "gamma.hpp"
 #include "infinity.hpp"
+#include "logsum.hpp"
+#include "stats.hpp"
+#include "trellis.hpp"
+#include "workspace.hpp"
 #include "xi.hpp"
 
 namespace ci {
@@ -46,9 +50,10 @@ namespace hmm {
     ----------
     train_full() :
       Closest implementation to Rabiner's pseudo-code
-      Unforgiving in RAM
-      Can be fastest if number of observations, emission symbols
-        and model states is small
+      Unforgiving in RAM: (3N + N^2) T values, in time-major trellises
+        that can live in files instead (Workspace<>::Backing())
+      Fastest when they fit: one forward and one backward sweep, where
+        train() makes three or four
 
     train() :
       Scales the best in time with a large number of observations,
@@ -58,281 +63,382 @@ namespace hmm {
 
     train_mem() :
       Similar to train(), but works to reduce RAM requirements
-        to a minimum.  There is a trade-off with how many
-        times we must sweep through the number of observations
+        to a minimum.  Sums accumulate in the output parameters
+        rather than in a separate Statistics<>
+
+    Every version does O(N) emission bookkeeping per observation: only
+      the observed symbol's numerators change, and one per-state
+      denominator serves all symbols and all transitions.
 
 
     ---------
     All functions take the same arguments.  Here is an example:
 
-    template <typename O, typename I, typename T, typename E>
+    template <typename O, typename I, typename T, typename E,
+              typename P = exact_policy>
     void train(const O& observed,
                I& initial,
                T& transition,
-               E& emission);
+               E& emission,
+               P = P());
+
+    The optional logsum_policy<> picks the log-add engine used by each
+      kernel (see logsum.hpp).  fast_policy trades ~1e-6 absolute error
+      in each log-add for speed, which is plenty for early iterations.
+
+    train_full() and train() also take a Workspace<> just before the
+      policy.  Keep one across iterations to avoid reallocating scratch
+      space, accumulators and BackCache<> columns every time.
   */
 
 
 
 
+namespace details {
+
+  //==================
+  // update_initial()
+  //  : initial in linear space from gam, the log-space gammas at the
+  //      first position (summed over sequences for estep())
+  //  : renormalized; float gammas at large |log P(O)| can be off by 1e-3
+  //  : log-zero is probability 0, not exp(inf)
+  template <typename I, typename G>
+  inline void update_initial(I& initial, const G& gam) {
+    typedef typename I::value_type U;
+    const std::size_t nstates = initial.size();
+    U normalizer = inf<U>();
+    for ( std::size_t y = 0; y < nstates; ++y )
+      normalizer = elnsum(normalizer, static_cast<U>(gam[y]));
+    for ( std::size_t y = 0; y < nstates; ++y )
+      initial[y] = eexp(elnproduct(static_cast<U>(gam[y]), -normalizer));
+  }
+
+} // namespace details
+
   //=============
   // train_full()
   //   : Re-estimate model parameters
   //   : Closest to Rabiner's pseudo-code
   //   : Inefficient in memory
-  template <typename O, typename I, typename T, typename E>
+  //   : One forward and one backward sweep fill the alpha and beta
+  //       trellises; gamma and xi are taken from both, and every trellis
+  //       is then read once, in time order
+  //   : All trellises are kept in ws between calls; see
+  //       Workspace<>::Backing() to keep large ones in files
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
   void train_full(const O& observed,
                   I& initial,
                   T& transition,
-                  E& emission) {
+                  E& emission,
+                  Workspace<U>& ws,
+                  P = P()) {
 
-    typedef float U;
     const std::size_t nstates = initial.size();
     const std::size_t nobs = observed.size();
     const std::size_t nsymbols = emission[0].size();
+    const typename P::forward_type lfwd = typename P::forward_type();
+    const typename P::backward_type lbkd = typename P::backward_type();
+    const typename P::xi_type lxi = typename P::xi_type();
+    const typename P::accumulate_type lacc = typename P::accumulate_type();
+    if ( nobs < 1 )
+      return;
 
-    std::vector< std::vector<U> > gam(initial.size());
-    for ( std::size_t i = 0; i < gam.size(); ++i )
-      gam[i].resize(observed.size(), 0);
-    gamma_m_full(observed, initial, transition, emission, gam);
-
-    std::vector< std::vector< std::vector<U> > > probs(nstates);
-    for ( std::size_t i = 0; i < probs.size(); ++i ) {
-      probs[i].resize(nstates);
-      for ( std::size_t j = 0; j < probs[i].size(); ++j )
-        probs[i][j].resize(nobs, 0);
-    } // for
-    xi_full(observed, initial, transition, emission, probs);
+    const details::EmitterScope<E> scope(ws.emitters, emission);
+    forward_full(observed, initial, transition, emission, nobs, ws.alphaT, ws, lfwd);
+    backward_full(observed, initial, transition, emission, 1, ws.betaT, ws, lbkd);
+    const Trellis<U>& gam = ws.gamT;
+    const Trellis<U>& probs = ws.xiT;
+    details::gamma_trellis(ws.alphaT, ws.betaT, nobs, ws.gamT, lfwd);
+    details::xi_trellis(observed, transition, emission, ws.alphaT, ws.betaT, ws.xiT, ws, lxi);
 
     // update initial
-    for ( std::size_t i = 0; i < gam.size(); ++i )
-      initial[i] = std::exp(gam[i][0]);
-
-    // update emission and transition
-    U numeratorE = inf<U>(), denominatorE = inf<U>();
-    U numeratorT = inf<U>(), denominatorT = inf<U>();
-    std::size_t sentinel = std::max(nsymbols, nstates);
-    for ( std::size_t i = 0; i < sentinel; ++i ) {
+    details::update_initial(initial, gam[0]);
+
+    // accumulate in time order; each position adds to its own symbol's
+    //  numerator and to the denominator shared by all symbols (and by
+    //  transition).  Every sum still runs over s in order, as it would
+    //  state by state
+    std::vector<U>& denominator = ws.stats.denominator;
+    std::vector< std::vector<U> >& numeratorT = ws.stats.numeratorT;
+    ws.stats.Reset(nstates, nsymbols);
+    for ( std::size_t s = 0; s < nobs-1; ++s ) {
+      const U* const g = gam[s];
+      const U* const x = probs[s];
+      std::vector<U>& numE = ws.stats.Symbol(observed[s]);
       for ( std::size_t j = 0; j < nstates; ++j ) {
-        numeratorE = inf<U>(), denominatorE = inf<U>();
-        numeratorT = inf<U>(), denominatorT = inf<U>();
-        for ( std::size_t s = 0; s < nobs-1; ++s ) {
-          if ( i < nsymbols ) { // emission
-            if ( observed[s] == i )
-              numeratorE = elnsum(numeratorE, gam[j][s]);
-            denominatorE = elnsum(denominatorE, gam[j][s]);
-          }
-
-          if ( i < nstates ) { // transition
-            numeratorT = elnsum(numeratorT, probs[i][j][s]);
-            denominatorT = elnsum(denominatorT, gam[i][s]);
-          }
-        } // for
-
-        if ( i < nsymbols ) // emission
-          emission[j][i] = elnproduct(numeratorE, -denominatorE);
-
-        if ( i < nstates ) // transition
-          transition[i][j] = elnproduct(numeratorT, -denominatorT);
+        numE[j] = lacc(numE[j], g[j]);
+        denominator[j] = lacc(denominator[j], g[j]);
       } // for
+      for ( std::size_t i = 0; i < nstates; ++i )
+        for ( std::size_t j = 0; j < nstates; ++j )
+          numeratorT[i][j] = lacc(numeratorT[i][j], x[i * nstates + j]);
+    } // for
+
+    // update emission and transition
+    for ( std::size_t i = 0; i < nstates; ++i ) {
+      details::update_emission(emission[i], ws.stats.numeratorE, i, denominator[i]);
+      for ( std::size_t j = 0; j < nstates; ++j )
+        transition[i][j] = elnproduct(numeratorT[i][j], -denominator[i]);
     } // for
   }
 
+  template <typename O, typename I, typename T, typename E,
+            typename P = exact_policy>
+  void train_full(const O& observed,
+                  I& initial,
+                  T& transition,
+                  E& emission,
+                  P policy = P()) {
+    Workspace<float> ws;
+    train_full(observed, initial, transition, emission, ws, policy);
+  }
+
   //=========
-  // train()
-  //   : Re-estimate model parameters
+  // estep()
+  //   : Accumulate Baum-Welch sufficient statistics for one sequence
+  //   : Adds to whatever stats already holds; see Statistics<>::Merge()
+  //       for combining results computed elsewhere
   //   : Efficient in time & memory with regards to num observations
-  //   : Best implementation for most discrete models
-  template <typename O, typename I, typename T, typename E>
-  void train(const O& observed,
-             I& initial,
-             T& transition,
-             E& emission) {
+  //   : Scratch columns and BackCache<> storage are taken from ws
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void estep(const O& observed,
+             const I& initial,
+             const T& transition,
+             const E& emission,
+             Statistics<U>& stats,
+             Workspace<U>& ws,
+             P = P()) {
 
     // Various constants
-    typedef typename O::value_type U;
-    const I& init(initial);
     const std::size_t nstates = initial.size();
     const std::size_t nobs = observed.size();
-    const std::size_t nsymbols = emission[0].size();
-    const std::size_t sentinel = std::max(nsymbols, nstates);
     const bool done = false;
-
-    // Various local arrays declared
-    std::vector<U> gam(nstates, 0), alphaG(gam), alphaX(gam);
-    std::vector< std::vector<U> > probs(nstates);
-    std::vector< std::vector<U> > numeratorT(nstates), denominatorT(nstates);
-    std::vector< std::vector<U> > numeratorE(nsymbols), denominatorE(nsymbols);
-
-    // Initialize values of local arrays
-    for ( std::size_t i = 0; i < sentinel; ++i ) {
-      if ( i < nstates ) {
-        probs[i].resize(nstates, 0);
-        numeratorT[i].resize(nstates, inf<U>());
-        denominatorT[i].resize(nstates, inf<U>());
-      }
-
-      if ( i < nsymbols ) {
-        numeratorE[i].resize(nstates, inf<U>());
-        denominatorE[i].resize(nstates, inf<U>());
-      }
-    } // for
-
-    // Prepare for back propogations
-    typedef details::BackCache<O, I, T, E, U> BCache;
-    BCache cache(observed, init, transition, emission);
+    const typename P::forward_type lfwd = typename P::forward_type();
+    const typename P::xi_type lxi = typename P::xi_type();
+    const typename P::accumulate_type lacc = typename P::accumulate_type();
+
+    // Various local arrays
+    std::vector<U>& gam = ws.gam;
+    std::vector<U>& alphaG = ws.alphaG;
+    std::vector<U>& alphaX = ws.alphaX;
+    std::vector< std::vector<U> >& probs = ws.probs;
+    std::vector<U>& denominator = stats.denominator;
+    std::vector< std::vector<U> >& numeratorT = stats.numeratorT;
+    gam.assign(nstates, 0), alphaG.assign(nstates, 0), alphaX.assign(nstates, 0);
+    details::shape(probs, nstates, nstates, static_cast<U>(0));
+
+    // Prepare for back propogations; kernels skip states that cannot emit
+    const details::EmitterScope<E> scope(ws.emitters, emission);
+    typedef details::BackCache<O, I, T, E, U, typename P::backward_type> BCache;
+    BCache cache(observed, initial, transition, emission, typename P::backward_type(), &ws);
     std::vector<U> const* beta = cache.Next();
-
-    // First gamma() call
-    gamma(observed, init, transition, emission, 1, *beta, alphaG, gam);
     if ( !beta )
       return;
-    delete beta;
+
+    // First gamma() call
+    gamma(observed, initial, transition, emission, 1, *beta, alphaG, gam, ws, lfwd);
+    U loglik = inf<U>();
+    for ( std::size_t y = 0; y < nstates; ++y )
+      loglik = lfwd(loglik, elnproduct(alphaG[y], (*beta)[y]));
+    cache.Release(beta);
 
     beta = cache.Next(); // xi's beta stays ahead of gamma's by one
     if ( !beta )
       return;
 
     // First xi() call
-    xi(observed, init, transition, emission, 1, *beta, alphaX, probs);
+    xi(observed, initial, transition, emission, 1, *beta, alphaX, probs, ws, lfwd, lxi);
 
-    // Update new initial state probabilities
+    // Initial state probabilities
     for ( std::size_t y = 0; y < nstates; ++y )
-      initial[y] = std::exp(gam[y]);
+      stats.initial[y] = lacc(stats.initial[y], gam[y]);
+    stats.loglik += loglik;
+    ++stats.nsequences;
 
     // Calculate intermediaries for emission and transition probabilities
+    //  : only the observed symbol's emission column changes at each step
     std::size_t s = 0;
     while ( !done ) {
-      for ( std::size_t i = 0; i < sentinel; ++i ) {
-        for ( std::size_t j = 0; j < nstates; ++j ) {
-          if ( i < nsymbols ) { // emission
-            if ( observed[s] == i )
-              numeratorE[i][j] = elnsum(numeratorE[i][j], gam[j]);
-            denominatorE[i][j] = elnsum(denominatorE[i][j], gam[j]);
-          }
-
-          if ( i < nstates ) { // transition
-            numeratorT[i][j] = elnsum(numeratorT[i][j], probs[i][j]);
-            denominatorT[i][j] = elnsum(denominatorT[i][j], gam[i]);
-          }
-        } // for 'j'
+      std::vector<U>& numE = stats.Symbol(observed[s]);
+      for ( std::size_t j = 0; j < nstates; ++j ) {
+        numE[j] = lacc(numE[j], gam[j]);
+        denominator[j] = lacc(denominator[j], gam[j]);
+      } // for 'j'
+
+      for ( std::size_t i = 0; i < nstates; ++i ) {
+        for ( std::size_t j = 0; j < nstates; ++j )
+          numeratorT[i][j] = lacc(numeratorT[i][j], probs[i][j]);
       } // for 'i'
 
       if ( ++s == nobs-1 )
         break;
-      gamma(observed, init, transition, emission, s+1, *beta, alphaG, gam);
-      delete beta;
+      gamma(observed, initial, transition, emission, s+1, *beta, alphaG, gam, ws, lfwd);
+      cache.Release(beta);
 
       beta = cache.Next(); // xi's beta stays ahead of gamma's by one
-      xi(observed, init, transition, emission, s+1, *beta, alphaX, probs);
+      xi(observed, initial, transition, emission, s+1, *beta, alphaX, probs, ws, lfwd, lxi);
     } // while !done
 
     if ( beta )
-      delete beta;
+      cache.Release(beta);
+  }
+
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void estep(const O& observed,
+             const I& initial,
+             const T& transition,
+             const E& emission,
+             Statistics<U>& stats,
+             P policy = P()) {
+    Workspace<U> ws;
+    estep(observed, initial, transition, emission, stats, ws, policy);
+  }
+
+  //=========
+  // mstep()
+  //   : Re-estimate model parameters from accumulated statistics
+  //   : initial is left in linear space, as with all train*() versions
+  //   : No-op if no sequence was accumulated
+  template <typename U, typename I, typename T, typename E>
+  void mstep(const Statistics<U>& stats,
+             I& initial,
+             T& transition,
+             E& emission) {
+
+    if ( 0 == stats.nsequences )
+      return;
+
+    const std::size_t nstates = stats.NStates();
+
+    // Update new initial state probabilities
+    details::update_initial(initial, stats.initial);
 
     // Update new emission and transitional probabilities
-    for ( std::size_t i = 0; i < sentinel; ++i ) {
-      for ( std::size_t j = 0; j < nstates; ++j ) {
-        if ( i < nsymbols ) // emission
-          emission[j][i] = elnproduct(numeratorE[i][j], -denominatorE[i][j]);
+    for ( std::size_t j = 0; j < nstates; ++j ) {
+      details::update_emission(emission[j], stats.numeratorE, j, stats.denominator[j]);
+      for ( std::size_t i = 0; i < nstates; ++i )
+        transition[j][i] = elnproduct(stats.numeratorT[j][i], -stats.denominator[j]);
+    } // for 'j'
+  }
 
-        if ( i < nstates ) // transition
-          transition[i][j] = elnproduct(numeratorT[i][j], -denominatorT[i][j]);
-      } // for 'j'
-    } // for 'i'
+  //=========
+  // train()
+  //   : Re-estimate model parameters
+  //   : Efficient in time & memory with regards to num observations
+  //   : Best implementation for most discrete models
+  //   : estep() followed by mstep()
+  //   : Reuse one ws across iterations and nothing is allocated after
+  //       the first
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename P = exact_policy>
+  void train(const O& observed,
+             I& initial,
+             T& transition,
+             E& emission,
+             Workspace<U>& ws,
+             P policy = P()) {
+
+    ws.stats.Reset(initial.size(), emission[0].size());
+    estep(observed, initial, transition, emission, ws.stats, ws, policy);
+    mstep(ws.stats, initial, transition, emission);
+  }
+
+  template <typename O, typename I, typename T, typename E,
+            typename P = exact_policy>
+  void train(const O& observed,
+             I& initial,
+             T& transition,
+             E& emission,
+             P policy = P()) {
+    Workspace<typename O::value_type> ws;
+    train(observed, initial, transition, emission, ws, policy);
   }
 
   //=============
   // train_mem()
   //   : Re-estimate model parameters
   //   : Most efficient in memory
-  template <typename O, typename I, typename T, typename E>
+  //   : One forward sweep; the output parameters themselves hold the
+  //       running sums, so nothing beyond the model copies, one BackCache<>
+  //       and a few columns is allocated
+  //   : emission must have dense rows; it doubles as an accumulator
+  template <typename O, typename I, typename T, typename E,
+            typename P = exact_policy>
   void train_mem(const O& observed,
                  I& initial,
                  T& transition,
-                 E& emission) {
+                 E& emission,
+                 P = P()) {
 
+    static_assert(!details::sparse_rows<E>::value, "train_mem() needs dense emission rows");
     typedef typename O::value_type U;
     const std::size_t nstates = initial.size();
     const std::size_t nobs = observed.size();
     const std::size_t nsymbols = emission[0].size();
+    const bool done = false;
 
     // involatile copies of originals necessary
     const I init(initial);
     const T trans(transition);
     const E emis(emission);
+    const typename P::forward_type lfwd = typename P::forward_type();
+    const typename P::xi_type lxi = typename P::xi_type();
+    const typename P::accumulate_type lacc = typename P::accumulate_type();
 
-    typedef details::BackCache<O, I, T, E, U> BCache;
-    const BCache cache(observed, init, trans, emis);
+    Workspace<U> ws;
+    std::vector<U> gam(nstates, 0), alphaG(gam), alphaX(gam);
+    std::vector<U> denominator(nstates, inf<U>());
+    std::vector< std::vector<U> > probs(nstates, std::vector<U>(nstates, 0));
 
-    std::vector<U> gam(nstates, 0), alphaG(gam);
-    std::vector< std::vector<U> > probs(nstates);
+    const details::EmitterScope<E> scope(ws.emitters, emis);
+    typedef details::BackCache<O, I, T, E, U, typename P::backward_type> BCache;
+    BCache cache(observed, init, trans, emis, typename P::backward_type(), &ws);
+    std::vector<U> const* beta = cache.Next();
+    if ( !beta )
+      return;
 
-    for ( std::size_t i = 0; i < nstates; ++i )
-      probs[i].resize(nstates, 0);
+    gamma(observed, init, trans, emis, 1, *beta, alphaG, gam, ws, lfwd);
+    cache.Release(beta);
+    beta = cache.Next(); // xi's beta stays ahead of gamma's by one
+    if ( !beta )
+      return;
+    xi(observed, init, trans, emis, 1, *beta, alphaX, probs, ws, lfwd, lxi);
 
-    // update emission and transition probabilities; update initial conditions
-    U numeratorE = inf<U>(), denominatorE = inf<U>();
-    U numeratorT = inf<U>(), denominatorT = inf<U>();
-    std::size_t sentinel = std::max(nsymbols, nstates);
-    for ( std::size_t i = 0; i < sentinel; ++i ) {
-      for ( std::size_t j = 0; j < nstates; ++j ) {
-        numeratorE = inf<U>(), denominatorE = inf<U>();
-        numeratorT = inf<U>(), denominatorT = inf<U>();
-        BCache gcache(cache);
-        std::vector<U> alphaG(nstates, 0);
-
-        // if-else is highly duplicated but worth it due to extra data copies for transition
-        if ( i < nstates ) {
-          BCache xcache(cache);
-          std::vector<U> alphaX(nstates, 0);
-          std::vector<U>* beta = xcache.Next(); // xi -> must move forward one
-          if ( !beta )
-            return;
-          delete beta;
-
-          for ( std::size_t s = 0; s < nobs-1; ++s ) {
-            gamma(observed, init, trans, emis, s+1, gcache, alphaG, gam);
-
-            if ( 0 == i && 0 == s && 0 == j ) { // update initial; must be the case: i < nstates
-              for ( std::size_t y = 0; y < nstates; ++y )
-                initial[y] = std::exp(gam[y]);
-            }
-
-            if ( i < nsymbols ) { // emission
-              if ( observed[s] == i )
-                numeratorE = elnsum(numeratorE, gam[j]);
-              denominatorE = elnsum(denominatorE, gam[j]);
-            }
-
-            // transition
-            xi(observed, init, trans, emis, s+1, xcache, alphaX, probs);
-            numeratorT = elnsum(numeratorT, probs[i][j]);
-            denominatorT = elnsum(denominatorT, gam[i]);
-          } // for
-
-          if ( i < nsymbols ) // emission
-            emission[j][i] = elnproduct(numeratorE, -denominatorE);
-
-          // transition
-          transition[i][j] = elnproduct(numeratorT, -denominatorT);
-        }
-        else { // no need to make all copies/checks for transition-related items
-          for ( std::size_t s = 0; s < nobs-1; ++s ) {
-            gamma(observed, init, trans, emis, s+1, gcache, alphaG, gam);
-
-            if ( i < nsymbols ) { // emission
-              if ( observed[s] == i )
-                numeratorE = elnsum(numeratorE, gam[j]);
-              denominatorE = elnsum(denominatorE, gam[j]);
-            }
-          } // for
-
-          if ( i < nsymbols ) // emission
-            emission[j][i] = elnproduct(numeratorE, -denominatorE);
-        }
+    // update initial; clear emission and transition to act as accumulators
+    details::update_initial(initial, gam);
+    for ( std::size_t y = 0; y < nstates; ++y ) {
+      std::fill(transition[y].begin(), transition[y].end(), inf<U>());
+      std::fill(emission[y].begin(), emission[y].end(), inf<U>());
+    } // for
 
+    std::size_t s = 0;
+    while ( !done ) {
+      for ( std::size_t j = 0; j < nstates; ++j ) {
+        emission[j][observed[s]] = lacc(emission[j][observed[s]], gam[j]);
+        denominator[j] = lacc(denominator[j], gam[j]);
+        for ( std::size_t k = 0; k < nstates; ++k )
+          transition[j][k] = lacc(transition[j][k], probs[j][k]);
       } // for
+
+      if ( ++s == nobs-1 )
+        break;
+      gamma(observed, init, trans, emis, s+1, *beta, alphaG, gam, ws, lfwd);
+      cache.Release(beta);
+
+      beta = cache.Next();
+      xi(observed, init, trans, emis, s+1, *beta, alphaX, probs, ws, lfwd, lxi);
+    } // while !done
+    cache.Release(beta);
+
+    // update emission and transition probabilities
+    for ( std::size_t j = 0; j < nstates; ++j ) {
+      for ( std::size_t i = 0; i < nsymbols; ++i )
+        emission[j][i] = elnproduct(emission[j][i], -denominator[j]);
+      for ( std::size_t i = 0; i < nstates; ++i )
+        transition[j][i] = elnproduct(transition[j][i], -denominator[j]);
     } // for
   }
 
@@ -0,0 +1,164 @@
+/*
+  FILE: trellis.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Mon Oct 19 13:40:07 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+
+#ifndef TRELLIS_HMM_R_HPP
+#define TRELLIS_HMM_R_HPP
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace ci {
+
+namespace hmm {
+
+  /*
+    ---------------------
+    Time-Major Trellises
+    ---------------------
+    The *_full algorithms keep a value per state (or per pair of states)
+      at every position.  A Trellis<> holds them in one block, row t
+      being the values at position t: alpha[t][i], or xi[t][i N + j].
+      Each step of a recursion then reads the row it just wrote and
+      writes the next one, so a sweep streams through memory in order,
+      forward or backward, where the older [state][time] layout touched
+      N separate heap arrays per step and xi_full() made N^2 of them.
+
+    Storage is aligned to a cache line and reused by later Resize()
+      calls that fit.  Backing() moves trellises of at least a given size
+      into a temporary file mapped with mmap(2), unlinked as soon as it
+      is opened, so the page cache rather than the heap holds them.  A
+      sequential sweep suits the kernel's read-ahead and write-back, and
+      train_full() can then run on trellises larger than memory.
+  */
+
+  //============
+  // Trellis<>
+  //   : rows x width values in one time-major block; row t at (*this)[t]
+  //   : Resize() leaves the values unspecified
+  //   : Not copyable; the *_full algorithms keep theirs in Workspace<>
+  template <typename U>
+  struct Trellis {
+    static constexpr std::size_t Alignment = 64;
+
+    Trellis() : data_(0), rows_(0), width_(0), bytes_(0), mapped_(false), minbytes_(0)
+      { }
+
+    ~Trellis()
+      { release(); }
+
+    //==========
+    // Resize()
+    //  : allocates only when the block must grow or move to or from a file
+    void Resize(std::size_t rows, std::size_t width) {
+      const std::size_t need = rows * width * sizeof(U);
+      const bool map = !dir_.empty() && need >= minbytes_ && need > 0;
+      if ( need > bytes_ || map != mapped_ ) {
+        release();
+        if ( need > 0 )
+          allocate(need, map);
+      }
+      rows_ = rows, width_ = width;
+    }
+
+    //===========
+    // Backing()
+    //  : blocks of at least minbytes go to a file under dir from the next
+    //      Resize() on; an empty dir keeps every block on the heap
+    void Backing(const std::string& dir, std::size_t minbytes) {
+      dir_ = dir;
+      minbytes_ = minbytes;
+    }
+
+    inline U* operator[](std::size_t t) { return(data_ + t * width_); }
+    inline const U* operator[](std::size_t t) const { return(data_ + t * width_); }
+    inline std::size_t Rows() const { return(rows_); }
+    inline std::size_t Width() const { return(width_); }
+    inline bool Mapped() const { return(mapped_); }
+
+  private:
+    Trellis(const Trellis&); // disabled purposefully
+    void operator=(const Trellis&); // disabled purposefully
+
+    void allocate(std::size_t need, bool map) {
+      const std::size_t bytes = (need + Alignment - 1) / Alignment * Alignment;
+      if ( !map ) {
+        data_ = static_cast<U*>(std::aligned_alloc(Alignment, bytes));
+        if ( !data_ )
+          throw std::bad_alloc();
+        bytes_ = bytes;
+        return;
+      }
+
+      std::vector<char> path(dir_.begin(), dir_.end());
+      const std::string name = "/rHMM-trellis-XXXXXX";
+      path.insert(path.end(), name.begin(), name.end());
+      path.push_back('\0');
+      const int fd = ::mkstemp(path.data());
+      if ( fd < 0 )
+        throw("Cannot create a trellis file in " + dir_ + ": " + std::strerror(errno));
+      ::unlink(path.data());
+      void* p = MAP_FAILED;
+      if ( 0 == ::ftruncate(fd, static_cast<off_t>(bytes)) )
+        p = ::mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      const int why = errno;
+      ::close(fd);
+      if ( p == MAP_FAILED )
+        throw("Cannot map a trellis file in " + dir_ + ": " + std::strerror(why));
+      ::madvise(p, bytes, MADV_SEQUENTIAL);
+      data_ = static_cast<U*>(p);
+      bytes_ = bytes;
+      mapped_ = true;
+    }
+
+    void release() {
+      if ( mapped_ )
+        ::munmap(data_, bytes_);
+      else
+        std::free(data_);
+      data_ = 0, bytes_ = 0, mapped_ = false;
+    }
+
+    U* data_;
+    std::size_t rows_, width_;
+    std::size_t bytes_; // allocated; at least rows_ * width_ values
+    bool mapped_;
+    std::string dir_;
+    std::size_t minbytes_;
+  };
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // TRELLIS_HMM_R_HPP
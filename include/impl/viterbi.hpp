@@ -25,52 +25,107 @@
 #ifndef VITERBI_HMM_R_HPP
 #define VITERBI_HMM_R_HPP
 
-#include <array>
 #include <cmath>
 #include <vector>
 
 #include "efun.hpp"
+#include "infinity.hpp"
+#include "step.hpp"
+#include "workspace.hpp"
 
 namespace ci {
 
 namespace hmm {
 
-  template <typename O, typename I, typename T, typename E, typename OutIter>
+namespace details {
+
+  //=================
+  // viterbi_steps()
+  //  : advance delta[active] through positions [first, last), writing the
+  //      most likely state at each; active names the final column on return
+  //  : each position reports its first best state, or state 0 if the
+  //      whole column is log-zero; log-zero ranks below every finite value
+  //  : with emitters, only the states that emit each symbol are computed,
+  //      and the rest of the column is log-zero; the output is unchanged
+  template <typename O, typename T, typename E, typename U, typename OutIter>
+  void viterbi_steps(const O& observed,
+                     const T& transition,
+                     const E& emission,
+                     std::size_t first,
+                     std::size_t last,
+                     std::vector<U>* delta,
+                     std::size_t& active,
+                     OutIter& out,
+                     const Emitters* emitters = 0) {
+    const MaxPlusRing<U> ring;
+    const Span all(transition.size());
+    std::size_t index = 0;
+    U gmx = inf<U>();
+    std::size_t passive = 1 - active;
+    for ( std::size_t s = first; s < last; ++s ) {
+      auto prev = [&](std::size_t k) { return(delta[active][k]); };
+      auto next = [&](std::size_t j, U v) {
+        delta[passive][j] = v;
+        if ( elngreater(v, gmx) )
+          gmx = v, index = j;
+      };
+      auto emis = [&](std::size_t j) { return(emission[j][observed[s]]); };
+      index = 0, gmx = inf<U>();
+      if ( emitters ) {
+        const std::vector<std::size_t>& to = (*emitters)[observed[s]];
+        delta[passive].assign(delta[passive].size(), inf<U>());
+        step_forward(ring, (*emitters)[observed[s-1]], to, transition, prev, next, emis);
+      } else
+        step_forward(ring, all, all, transition, prev, next, emis);
+      *out++ = index;
+      std::swap(active, passive);
+    } // for
+  }
+
+} // namespace details
+
+  //===========
+  // viterbi()
+  //  - writes the most likely state at each position to out
+  //  - scratch space comes from ws
+  //  - log-zero ranks below every finite value (elngreater()); a position
+  //      whose states are all log-zero reports state 0
+  //  - binds ws.emitters to emission while it runs, so states that cannot
+  //      emit a position's symbol are not computed there
+  //===========
+  template <typename O, typename I, typename T, typename E, typename OutIter, typename U>
   void viterbi(const O& observed,
                const I& initial,
                const T& transition,
                const E& emission,
-               OutIter out) {
-    typedef typename O::value_type U;
+               OutIter out,
+               Workspace<U>& ws) {
     const std::size_t nstates = initial.size();
     std::size_t nobs = observed.size();
-    std::vector<std::array<U,2>> delta(nstates); // only need [2] x [n_states] 2-d array
+    std::vector<U>* delta = ws.roll; // only need [2] x [n_states] 2-d array
+    delta[0].resize(nstates), delta[1].resize(nstates);
+    const details::EmitterScope<E> scope(ws.emitters, emission);
+    const details::Emitters* emitters = ws.emitters.Bound(emission) ? &ws.emitters : 0;
     std::size_t index = 0;
     for ( std::size_t i = 0; i < nstates; ++i ) {
-      delta[i][0] = elnproduct(initial[i], emission[i][observed[0]]);
-      if ( delta[i][0] > delta[index][0] )
+      delta[0][i] = elnproduct(initial[i], emission[i][observed[0]]);
+      if ( elngreater(delta[0][i], delta[0][index]) )
         index = i;
     } // for
 
     *out++ = index;
-    index = 0;
-    U gmx = 0;
-    std::size_t active = 0, passive = active + 1;
-    for ( std::size_t s = 1; s < nobs; ++s ) {
-      for ( std::size_t j = 0; j < nstates; ++j ) {
-        U mx = elnproduct(delta[0][active], transition[0][j]), tmp = mx;
-        for ( std::size_t k = 1; k < nstates; ++k ) {
-          tmp = elnproduct(delta[k][active], transition[k][j]);
-          if ( tmp > mx )
-            mx = tmp;
-        } // for
-        delta[j][passive] = elnproduct(mx, emission[j][observed[s]]);
-        if ( delta[j][passive] > gmx || 0 == j )
-          gmx = delta[j][passive], index = j;
-      } // for
-      *out++ = index;
-      std::swap(active, passive);
-    } // for
+    std::size_t active = 0;
+    details::viterbi_steps(observed, transition, emission, 1, nobs, delta, active, out, emitters);
+  }
+
+  template <typename O, typename I, typename T, typename E, typename OutIter>
+  void viterbi(const O& observed,
+               const I& initial,
+               const T& transition,
+               const E& emission,
+               OutIter out) {
+    Workspace<typename O::value_type> ws;
+    viterbi(observed, initial, transition, emission, out, ws);
   }
 
 } // namespace hmm
@@ -0,0 +1,247 @@
+/*
+  FILE: workspace.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 13:48:52 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef WORKSPACE_HMM_R_HPP
+#define WORKSPACE_HMM_R_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "infinity.hpp"
+#include "sparse.hpp"
+#include "stats.hpp"
+#include "trellis.hpp"
+
+namespace ci {
+
+namespace hmm {
+
+namespace details {
+
+  //===============
+  // VectorPool<>
+  //   : Free list of heap vectors handed out by BackCache<>
+  //   : Vectors come back through Put() and are reused by Get(), so a
+  //       warm pool makes no allocations
+  //   : Get() and Put() may be called from different threads
+  template <typename U>
+  struct VectorPool {
+    VectorPool()
+      { }
+
+    ~VectorPool() {
+      for ( std::size_t i = 0; i < free_.size(); ++i )
+        delete free_[i];
+    }
+
+    inline std::vector<U>* Get(const std::vector<U>& v) {
+      std::vector<U>* rtn = 0;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if ( !free_.empty() )
+          rtn = free_.back(), free_.pop_back();
+      }
+      if ( !rtn )
+        return(new std::vector<U>(v));
+      rtn->assign(v.begin(), v.end());
+      return(rtn);
+    }
+
+    inline void Put(std::vector<U>* v) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(v);
+    }
+
+  private:
+    VectorPool(const VectorPool&); // disabled purposefully
+    void operator=(const VectorPool&); // disabled purposefully
+
+    std::vector< std::vector<U>* > free_;
+    std::mutex mutex_;
+  };
+
+  //============
+  // Emitters
+  //   : For each symbol, the states that can emit it (emission not log-zero)
+  //   : Bound to one emission matrix while an EmitterScope<> is open on it;
+  //       the per-step kernels then sum only over those states
+  //   : Never bound for a model with no log-zero emissions
+  struct Emitters {
+    Emitters() : bound_(0)
+      { }
+
+    template <typename E>
+    inline bool Bound(const E& emission) const
+      { return(bound_ == static_cast<const void*>(&emission)); }
+
+    template <typename S>
+    inline const std::vector<std::size_t>& operator[](S symbol) const
+      { return(bySymbol_[static_cast<std::size_t>(symbol)]); }
+
+  private:
+    template <typename E> friend struct EmitterScope;
+
+    std::vector< std::vector<std::size_t> > bySymbol_;
+    const void* bound_;
+  };
+
+  //=================
+  // EmitterScope<>
+  //   : Builds and binds the Emitters for emission for its lifetime
+  //   : Nested scopes leave an existing binding alone
+  template <typename E>
+  struct EmitterScope {
+    EmitterScope(Emitters& em, const E& emission) : em_(em), owner_(0 == em.bound_) {
+      if ( !owner_ || emission.empty() )
+        return;
+
+      const std::size_t nstates = emission.size(), nsymbols = emission[0].size();
+      bool sparse = false;
+      em_.bySymbol_.resize(nsymbols);
+      for ( std::size_t i = 0; i < nsymbols; ++i )
+        em_.bySymbol_[i].clear();
+      for ( std::size_t j = 0; j < nstates; ++j )
+        emitted(emission[j], [&](std::size_t m) { em_.bySymbol_[m].push_back(j); });
+      for ( std::size_t i = 0; i < nsymbols && !sparse; ++i )
+        sparse = (em_.bySymbol_[i].size() < nstates);
+      if ( sparse )
+        em_.bound_ = &emission;
+    }
+
+    ~EmitterScope() {
+      if ( owner_ )
+        em_.bound_ = 0;
+    }
+
+  private:
+    EmitterScope(const EmitterScope&); // disabled purposefully
+    void operator=(const EmitterScope&); // disabled purposefully
+
+    Emitters& em_;
+    const bool owner_;
+  };
+
+} // namespace details
+
+  //==============
+  // Workspace<>
+  //   : Reusable scratch space for every per-step kernel and for train*()
+  //   : Pass the same Workspace<> to repeated calls (e.g. one per training
+  //       iteration) and nothing is allocated once it has warmed up
+  //   : Buffers size themselves on first use; Reserve() presizes them for
+  //       a model with nstates states and nsymbols symbols
+  //   : Not thread-safe; use one per thread
+  template <typename U>
+  struct Workspace {
+
+    //==============
+    // Constructors
+    Workspace()
+      { }
+
+    Workspace(std::size_t nstates, std::size_t nsymbols)
+      { Reserve(nstates, nsymbols); }
+
+    //===========
+    // Reserve()
+    void Reserve(std::size_t nstates, std::size_t nsymbols) {
+      last.resize(nstates);
+      roll[0].resize(nstates), roll[1].resize(nstates);
+      gam.resize(nstates), alphaG.resize(nstates), alphaX.resize(nstates), beta.resize(nstates);
+      probs.resize(nstates);
+      for ( std::size_t i = 0; i < nstates; ++i )
+        probs[i].resize(nstates);
+      stats.Reset(nstates, nsymbols);
+    }
+
+    //===========
+    // Backing()
+    //  : keeps the *_full trellises of at least minbytes in files under
+    //      dir (see Trellis<>); an empty dir keeps them on the heap
+    void Backing(const std::string& dir, std::size_t minbytes) {
+      alphaT.Backing(dir, minbytes), betaT.Backing(dir, minbytes);
+      gamT.Backing(dir, minbytes), xiT.Backing(dir, minbytes);
+    }
+
+    // forward_next(), backward_next(), backward_enext(): previous column
+    std::vector<U> last;
+
+    // forward_index(), backward_index(), viterbi(): two rolling columns
+    std::vector<U> roll[2];
+
+    // gamma/xi columns used by estep(), evalp() and gamma_t_full()
+    std::vector<U> gam, alphaG, alphaX, beta;
+    std::vector< std::vector<U> > probs;
+
+    // forward_full()/backward_full() trellises for the *_full algorithms;
+    //  time-major, with xiT holding the N x N pairs of a position per row
+    Trellis<U> alphaT, betaT, gamT, xiT;
+
+    // contiguous scratch for the fixed-size kernels (fixed.hpp)
+    std::vector<U> flat;
+
+    // int16 columns for viterbi_quantized() (quant.hpp)
+    std::vector<std::int16_t> quant;
+
+    // per-symbol emitting states, bound while a top-level kernel runs
+    details::Emitters emitters;
+
+    // training accumulators and recycled BackCache<> columns
+    Statistics<U> stats;
+    details::VectorPool<U> pool;
+
+    // second-half statistics for estep_split() (split.hpp), and the
+    //  expanded statistics of train_masked() (mask.hpp)
+    Statistics<U> half;
+
+    // expanded emissions for train_masked() (mask.hpp)
+    std::vector< std::vector<U> > masked;
+
+  private:
+    Workspace(const Workspace&); // disabled purposefully
+    void operator=(const Workspace&); // disabled purposefully
+  };
+
+namespace details {
+
+  //=========
+  // shape()
+  //  : (re)fill a 2-d buffer with value; allocates only when it must grow
+  template <typename U>
+  inline void shape(std::vector< std::vector<U> >& v, std::size_t rows, std::size_t cols, U value) {
+    v.resize(rows);
+    for ( std::size_t i = 0; i < rows; ++i )
+      v[i].assign(cols, value);
+  }
+
+} // namespace details
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // WORKSPACE_HMM_R_HPP
@@ -0,0 +1,250 @@
+/*
+  FILE: writer.hpp
+  AUTHOR: Shane Neph
+  CREATE DATE: Sun Oct 18 15:20:16 PDT 2026
+*/
+
+//    Hidden Markov Model
+//    Copyright (C) 2013 Shane Neph
+//
+//    This program is free software; you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation; either version 2 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License along
+//    with this program; if not, write to the Free Software Foundation, Inc.,
+//    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#ifndef WRITER_HMM_R_HPP
+#define WRITER_HMM_R_HPP
+
+#include <algorithm>
+#include <charconv>
+#include <condition_variable>
+#include <cstddef>
+#include <iterator>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ci {
+
+namespace hmm {
+
+  //==============
+  // AsyncWriter
+  //   : Double-buffered output; a helper thread writes one buffer to the
+  //       stream while the caller fills the other
+  //   : Flush() returns once everything handed over has been written
+  //   : Buffers are at least MinSize characters
+  class AsyncWriter {
+  public:
+    static constexpr std::size_t MinSize = 256;
+
+    explicit AsyncWriter(std::ostream& os, std::size_t size = 1 << 20)
+                        : os_(os), size_(std::max(size, MinSize)), fill_(0), pending_(0), done_(false),
+                          front_(size_), back_(size_), thread_(&AsyncWriter::run, this)
+      { }
+
+    ~AsyncWriter() {
+      Flush();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_ = true;
+      }
+      ready_.notify_all();
+      thread_.join();
+    }
+
+    //===========
+    // Reserve()
+    //  : room for n more characters; n must not exceed MinSize
+    inline char* Reserve(std::size_t n) {
+      if ( fill_ + n > size_ )
+        handoff();
+      return(&front_[fill_]);
+    }
+
+    //==========
+    // Commit()
+    inline void Commit(char* end)
+      { fill_ = end - &front_[0]; }
+
+    //=========
+    // Write()
+    inline void Write(const std::string& s) {
+      for ( std::size_t i = 0; i < s.size(); i += size_ ) {
+        const std::size_t n = std::min(size_, s.size() - i);
+        char* p = Reserve(n);
+        Commit(std::copy(s.begin() + i, s.begin() + i + n, p));
+      } // for
+    }
+
+    //=========
+    // Flush()
+    void Flush() {
+      handoff();
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this] { return(0 == pending_); });
+      os_.flush();
+    }
+
+  private:
+    AsyncWriter(const AsyncWriter&); // disabled purposefully
+    void operator=(const AsyncWriter&); // disabled purposefully
+
+    void handoff() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this] { return(0 == pending_); });
+      if ( 0 == fill_ )
+        return;
+      front_.swap(back_);
+      pending_ = fill_;
+      fill_ = 0;
+      lock.unlock();
+      ready_.notify_all();
+    }
+
+    void run() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while ( true ) {
+        ready_.wait(lock, [this] { return(pending_ || done_); });
+        if ( pending_ ) {
+          const std::size_t n = pending_;
+          lock.unlock();
+          os_.write(&back_[0], n);
+          lock.lock();
+          pending_ = 0;
+          ready_.notify_all();
+        }
+        else
+          return;
+      } // while
+    }
+
+  private:
+    std::ostream& os_;
+    const std::size_t size_;
+    std::size_t fill_, pending_;
+    bool done_;
+    std::vector<char> front_, back_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::thread thread_; // last: starts running during construction
+  };
+
+  //===============
+  // DecodeWriter
+  //   : Formats decoded states for an AsyncWriter
+  //   : STATES   - one state per position, space separated (original format)
+  //   : SEGMENTS - one line per run of identical states: start end state
+  //                  0-based, half-open, tab separated
+  //   : BED      - SEGMENTS preceded by a sequence name column
+  //   : Finish() writes anything pending; call once after the last state
+  class DecodeWriter {
+  public:
+    enum class Format { STATES, SEGMENTS, BED };
+
+    DecodeWriter(AsyncWriter& w, Format f, const std::string& name = "")
+                : w_(w), format_(f), name_(name), pos_(0), start_(0), state_(0)
+      { }
+
+    //=============
+    // operator()
+    inline void operator()(std::size_t state) {
+      if ( format_ == Format::STATES ) {
+        char* p = w_.Reserve(Width);
+        p = std::to_chars(p, p + Width, state).ptr;
+        *p++ = ' ';
+        w_.Commit(p);
+      }
+      else if ( pos_ > start_ && state != state_ ) {
+        segment();
+        start_ = pos_;
+      }
+      state_ = state;
+      ++pos_;
+    }
+
+    //==========
+    // Finish()
+    void Finish() {
+      if ( format_ == Format::STATES ) {
+        char* p = w_.Reserve(1);
+        *p++ = '\n';
+        w_.Commit(p);
+      }
+      else if ( pos_ > start_ ) {
+        segment();
+        start_ = pos_;
+      }
+    }
+
+  private:
+    static constexpr std::size_t Width = 3 * 24; // 3 numbers + separators
+
+    void segment() {
+      if ( format_ == Format::BED ) {
+        w_.Write(name_);
+        char* p = w_.Reserve(1);
+        *p++ = '\t';
+        w_.Commit(p);
+      }
+      char* p = w_.Reserve(Width);
+      char* const end = p + Width;
+      p = std::to_chars(p, end, start_).ptr, *p++ = '\t';
+      p = std::to_chars(p, end, pos_).ptr, *p++ = '\t';
+      p = std::to_chars(p, end, state_).ptr, *p++ = '\n';
+      w_.Commit(p);
+    }
+
+  private:
+    AsyncWriter& w_;
+    const Format format_;
+    const std::string name_;
+    std::size_t pos_, start_, state_;
+  };
+
+  //=================
+  // decode_iterator
+  //   : Output iterator over a DecodeWriter, suitable for viterbi()
+  struct decode_iterator {
+    typedef std::output_iterator_tag iterator_category;
+    typedef void value_type;
+    typedef void difference_type;
+    typedef void pointer;
+    typedef void reference;
+
+    explicit decode_iterator(DecodeWriter& d) : d_(&d)
+      { }
+
+    inline decode_iterator& operator=(std::size_t state)
+      { (*d_)(state); return(*this); }
+
+    inline decode_iterator& operator*()
+      { return(*this); }
+
+    inline decode_iterator& operator++()
+      { return(*this); }
+
+    inline decode_iterator operator++(int)
+      { return(*this); }
+
+  private:
+    DecodeWriter* d_;
+  };
+
+} // namespace hmm
+
+} // namespace ci
+
+#endif // WRITER_HMM_R_HPP
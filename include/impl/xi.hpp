@@ -25,60 +25,154 @@
 #ifndef XI_HMM_R_HPP
 #define XI_HMM_R_HPP
 
+#include <algorithm>
 #include <vector>
 
 #include "bkd.hpp"
 #include "efun.hpp"
 #include "fwd.hpp"
 #include "infinity.hpp"
+#include "logsum.hpp"
+#include "trellis.hpp"
+#include "workspace.hpp"
 
 
 namespace ci {
 
 namespace hmm {
 
+namespace details {
+
+  //==============
+  // xi_trellis()
+  //  : row s of probs gets xi at positions s and s+1, pair (i, j) at
+  //      i N + j, from the alpha and beta trellises; one row per
+  //      observation but the last
+  //  : uses ws.emitters when a caller has bound them to emission; pairs
+  //      whose alpha or emission is log-zero are set to log-zero without
+  //      being computed
+  template <typename O, typename T, typename E, typename U, typename L>
+  void xi_trellis(const O& observed,
+                  const T& transition,
+                  const E& emission,
+                  const Trellis<U>& alpha,
+                  const Trellis<U>& beta,
+                  Trellis<U>& probs,
+                  Workspace<U>& ws,
+                  L lxi) {
+    const std::size_t nstates = transition.size();
+    const std::size_t nobs = observed.size();
+    const bool sparse = ws.emitters.Bound(emission);
+    probs.Resize(nobs-1, nstates * nstates);
+    for ( std::size_t s = 0; s < nobs-1; ++s ) {
+      const U* const a = alpha[s];
+      const U* const b = beta[s+1];
+      U* const x = probs[s];
+      U normalizer = inf<U>();
+      if ( sparse ) {
+        const std::vector<std::size_t>& to = ws.emitters[observed[s+1]];
+        std::fill(x, x + nstates * nstates, inf<U>());
+        for ( std::size_t i : ws.emitters[observed[s]] ) {
+          U* const row = x + i * nstates;
+          for ( std::size_t j : to ) {
+            row[j] = elnproduct(a[i],
+                                elnproduct(transition[i][j],
+                                           elnproduct(emission[j][observed[s+1]], b[j])));
+            normalizer = lxi(normalizer, row[j]);
+          } // for
+        } // for
+        for ( std::size_t i : ws.emitters[observed[s]] )
+          for ( std::size_t j : to )
+            x[i * nstates + j] = elnproduct(x[i * nstates + j], -normalizer);
+        continue;
+      }
+
+      for ( std::size_t i = 0; i < nstates; ++i ) {
+        U* const row = x + i * nstates;
+        for ( std::size_t j = 0; j < nstates; ++j ) {
+          row[j] = elnproduct(a[i],
+                              elnproduct(transition[i][j],
+                                         elnproduct(emission[j][observed[s+1]], b[j])));
+          normalizer = lxi(normalizer, row[j]);
+        } // for
+      } // for
+
+      for ( std::size_t k = 0; k < nstates * nstates; ++k )
+        x[k] = elnproduct(x[k], -normalizer);
+    } // for
+  }
+
+} // namespace details
+
   //=====================
   // xi_full()
   //  - Evaluate the probability of q_t being in state i and q_(t+1) being
   //     in state j given observations and model.
-  //  - Computes all N*N*T probabilities and stores in probs
+  //  - Computes all N*N*T probabilities and stores in probs, resized to
+  //     one row per observation but the last: row s holds pair (i, j) of
+  //     positions s and s+1 at i N + j
+  //  - alpha and beta trellises are kept in ws
+  //  - binds ws.emitters to emission while it runs; pairs whose alpha or
+  //     emission is log-zero are set to log-zero without being computed
   //=====================
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LB = exact_logsum,
+            typename LX = exact_logsum>
   void xi_full(const O& observed,
                const I& initial,
                const T& transition,
                const E& emission,
-               std::vector< std::vector< std::vector<U> > >& probs) {
+               Trellis<U>& probs,
+               Workspace<U>& ws,
+               LF lfwd = LF(),
+               LB lbkd = LB(),
+               LX lxi = LX()) {
 
-    const std::size_t nstates = initial.size();
     const std::size_t nobs = observed.size();
     if ( nobs < 1 )
       return;
 
-    std::vector< std::vector<U> > alpha(nstates), beta(nstates);
-    for ( std::size_t i = 0; i < alpha.size(); ++i )
-      alpha[i].resize(nobs, 0), beta[i].resize(nobs, 0);
-
-    forward_full(observed, initial, transition, emission, nobs, alpha);
-    backward_full(observed, initial, transition, emission, 1, beta);
+    const details::EmitterScope<E> scope(ws.emitters, emission);
+    forward_full(observed, initial, transition, emission, nobs, ws.alphaT, ws, lfwd);
+    backward_full(observed, initial, transition, emission, 1, ws.betaT, ws, lbkd);
+    details::xi_trellis(observed, transition, emission, ws.alphaT, ws.betaT, probs, ws, lxi);
+  }
 
-    U normalizer = inf<U>();
-    for ( std::size_t s = 0; s < nobs-1; ++s ) {
-      normalizer = inf<U>();
-      for ( std::size_t i = 0; i < nstates; ++i ) {
-        for ( std::size_t j = 0; j < nstates; ++j ) {
-          probs[i][j][s] = elnproduct(alpha[i][s],
-                                      elnproduct(transition[i][j],
-                                                 elnproduct(emission[j][observed[s+1]],
-                                                            beta[j][s+1])));
-          normalizer = elnsum(normalizer, probs[i][j][s]);
-        } // for
-      } // for
+  //  - [i][j][time] version: fills probs[i][j][s] for all but the last
+  //     position in arrays sized by the caller, by way of ws.xiT
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LB = exact_logsum,
+            typename LX = exact_logsum>
+  void xi_full(const O& observed,
+               const I& initial,
+               const T& transition,
+               const E& emission,
+               std::vector< std::vector< std::vector<U> > >& probs,
+               Workspace<U>& ws,
+               LF lfwd = LF(),
+               LB lbkd = LB(),
+               LX lxi = LX()) {
+    const std::size_t nstates = initial.size();
+    xi_full(observed, initial, transition, emission, ws.xiT, ws, lfwd, lbkd, lxi);
+    for ( std::size_t s = 0; s+1 < observed.size(); ++s )
+      for ( std::size_t i = 0; i < nstates; ++i )
+        for ( std::size_t j = 0; j < nstates; ++j )
+          probs[i][j][s] = ws.xiT[s][i * nstates + j];
+  }
 
-      for ( std::size_t k = 0; k < nstates; ++k )
-        for ( std::size_t m = 0; m < nstates; ++m )
-          probs[k][m][s] = elnproduct(probs[k][m][s], -normalizer);
-    } // for
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LB = exact_logsum,
+            typename LX = exact_logsum>
+  void xi_full(const O& observed,
+               const I& initial,
+               const T& transition,
+               const E& emission,
+               std::vector< std::vector< std::vector<U> > >& probs,
+               LF lfwd = LF(),
+               LB lbkd = LB(),
+               LX lxi = LX()) {
+    Workspace<U> ws;
+    xi_full(observed, initial, transition, emission, probs, ws, lfwd, lbkd, lxi);
   }
 
 
@@ -87,8 +181,10 @@ namespace hmm {
   //  - Evaluate the probability of q_t being in state i and q_(t+1) being
   //     in state j given observations and model.
   //  - Minimizes memory requirements if used correctly: N*N
+  //  - uses ws.emitters when a caller has bound them to emission
   //=====================
-  template <typename O, typename I, typename T, typename E, typename U>
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LX = exact_logsum>
   void xi(const O& observed,
           const I& initial,
           const T& transition,
@@ -96,19 +192,42 @@ namespace hmm {
           int index,
           const std::vector<U>& beta,
           std::vector<U>& alpha,
-          std::vector< std::vector<U> >& probs) {
+          std::vector< std::vector<U> >& probs,
+          Workspace<U>& ws,
+          LF lfwd = LF(),
+          LX lxi = LX()) {
 
     const std::size_t nstates = initial.size();
-    forward_next(observed, initial, transition, emission, index, alpha);
+    forward_next(observed, initial, transition, emission, index, alpha, ws, lfwd);
 
     U normalizer = inf<U>();
+    if ( ws.emitters.Bound(emission) ) {
+      const std::vector<std::size_t>& from = ws.emitters[observed[index-1]];
+      const std::vector<std::size_t>& to = ws.emitters[observed[index]];
+      for ( std::size_t i = 0; i < nstates; ++i )
+        std::fill(probs[i].begin(), probs[i].end(), inf<U>());
+      for ( std::size_t i : from ) {
+        for ( std::size_t j : to ) {
+          probs[i][j] = elnproduct(alpha[i],
+                                   elnproduct(transition[i][j],
+                                              elnproduct(emission[j][observed[index]],
+                                                         beta[j])));
+          normalizer = lxi(normalizer, probs[i][j]);
+        } // for
+      } // for
+      for ( std::size_t i : from )
+        for ( std::size_t j : to )
+          probs[i][j] = elnproduct(probs[i][j], -normalizer);
+      return;
+    }
+
     for ( std::size_t i = 0; i < nstates; ++i ) {
       for ( std::size_t j = 0; j < nstates; ++j ) {
         probs[i][j] = elnproduct(alpha[i],
                                  elnproduct(transition[i][j],
                                             elnproduct(emission[j][observed[index]],
                                                        beta[j])));
-        normalizer = elnsum(normalizer, probs[i][j]);
+        normalizer = lxi(normalizer, probs[i][j]);
       } // for
     } // for
 
@@ -117,6 +236,22 @@ namespace hmm {
         probs[k][m] = elnproduct(probs[k][m], -normalizer);
   }
 
+  template <typename O, typename I, typename T, typename E, typename U,
+            typename LF = exact_logsum, typename LX = exact_logsum>
+  void xi(const O& observed,
+          const I& initial,
+          const T& transition,
+          const E& emission,
+          int index,
+          const std::vector<U>& beta,
+          std::vector<U>& alpha,
+          std::vector< std::vector<U> >& probs,
+          LF lfwd = LF(),
+          LX lxi = LX()) {
+    Workspace<U> ws;
+    xi(observed, initial, transition, emission, index, beta, alpha, probs, ws, lfwd, lxi);
+  }
+
 } // namespace hmm
 
 } // namespace ci
@@ -23,13 +23,22 @@
 //
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <map>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <sys/resource.h>
+#include <unistd.h>
+
 #include "hmm.hpp"
 
 namespace {
@@ -71,6 +80,28 @@ namespace {
     } // for
   }
 
+  // true if a trained model would reload: initial (linear space, as every
+  //  train*() leaves it) sums to 1 within the tolerance rHMM reads parameter
+  //  files with, and each transition and emission row (log space) within
+  //  rows; float sums over many positions drift further than 1e-4
+  template <typename I, typename T, typename E>
+  bool reloads(const I& initial, const T& transition, const E& emission, double rows = 1e-4) {
+    const double epsilon = 1e-4;
+    double sum = 0;
+    for ( std::size_t i = 0; i < initial.size(); ++i )
+      sum += initial[i];
+    bool ok = std::abs(sum - 1) <= epsilon;
+    for ( std::size_t i = 0; i < initial.size(); ++i ) {
+      double sumT = 0, sumE = 0;
+      for ( std::size_t j = 0; j < transition[i].size(); ++j )
+        sumT += ci::hmm::eexp(transition[i][j]);
+      for ( std::size_t m = 0; m < emission[i].size(); ++m )
+        sumE += ci::hmm::eexp(emission[i][m]);
+      ok = ok && std::abs(sumT - 1) <= rows && std::abs(sumE - 1) <= rows;
+    } // for
+    return(ok);
+  }
+
 } // empty namespace
 
 
@@ -352,5 +383,824 @@ int main()
     } // for
   } // for
 
+  // Test that a reused Workspace<> gives the same training results
+  std::cout << "Workspace Training" << std::endl;
+  std::vector<T> wsinitial(keepinitial), lginitial(keepinitial);
+  std::vector< std::vector<T> > wstransition(keeptransition), lgtransition(keeptransition);
+  std::vector< std::vector<T> > wsemission(keepemission), lgemission(keepemission);
+  ci::hmm::Workspace<T> ws;
+  for ( std::size_t i = 0; i < numiter; ++i ) {
+    ci::hmm::train(observed, wsinitial, wstransition, wsemission, ws);
+    ci::hmm::train(observed, lginitial, lgtransition, lgemission);
+  } // for
+  if ( wsinitial != lginitial || wstransition != lgtransition || wsemission != lgemission ) {
+    std::cout << "FAILED: Workspace<> training differs" << std::endl;
+    return(1);
+  }
+  std::cout << "Identical" << std::endl;
+
+  // Test that train_mem() accumulates exactly what train() does
+  std::cout << "Memory-Efficient Training" << std::endl;
+  std::vector<T> meminitial(keepinitial);
+  std::vector< std::vector<T> > memtransition(keeptransition), mememission(keepemission);
+  lginitial = keepinitial, lgtransition = keeptransition, lgemission = keepemission;
+  ci::hmm::train_mem(observed, meminitial, memtransition, mememission);
+  ci::hmm::train(observed, lginitial, lgtransition, lgemission);
+  if ( memtransition != lgtransition || mememission != lgemission ) {
+    std::cout << "FAILED: train_mem() differs from train()" << std::endl;
+    return(1);
+  }
+  std::cout << "Identical" << std::endl;
+
+  // Test that the fixed-size kernels match the generic ones exactly
+  std::cout << "Fixed-Size Kernels" << std::endl;
+  std::vector<T> fxinitial(keepinitial);
+  std::vector< std::vector<T> > fxtransition(keeptransition), fxemission(keepemission);
+  lginitial = keepinitial, lgtransition = keeptransition, lgemission = keepemission;
+  ci::hmm::Workspace<T> fxws;
+  for ( std::size_t i = 0; i < numiter; ++i ) {
+    ci::hmm::train_auto(observed, fxinitial, fxtransition, fxemission, fxws);
+    ci::hmm::train(observed, lginitial, lgtransition, lgemission);
+  } // for
+  std::vector<std::size_t> fxpath, lgpath;
+  ci::hmm::viterbi_auto(observed, keepinitial, keeptransition, keepemission, std::back_inserter(fxpath), fxws);
+  ci::hmm::viterbi(observed, keepinitial, keeptransition, keepemission, std::back_inserter(lgpath));
+  if ( fxinitial != lginitial || fxtransition != lgtransition || fxemission != lgemission || fxpath != lgpath ) {
+    std::cout << "FAILED: fixed-size kernels differ" << std::endl;
+    return(1);
+  }
+  if ( ci::hmm::evalp_auto(observed, fxinitial, fxtransition, fxemission, fxws) !=
+       ci::hmm::evalp(observed, lginitial, lgtransition, lgemission) ) {
+    std::cout << "FAILED: evalp_fixed() differs" << std::endl;
+    return(1);
+  }
+  std::cout << "Identical" << std::endl;
+
+  // Test batch kernels on ragged pieces of the observations
+  std::cout << "Batch Kernels" << std::endl;
+  std::vector< std::vector<T> > pieces;
+  for ( std::size_t i = 0, len = 0; i < observed.size(); i += len, len = (len * 7 + 3) % 23 )
+    pieces.push_back(std::vector<T>(observed.begin() + i, observed.begin() + std::min(observed.size(), i + len)));
+  std::vector< std::vector<std::size_t> > batchpaths;
+  std::vector<float> batchlogs;
+  ci::hmm::viterbi_batch<4>(pieces, keepinitial, keeptransition, keepemission, batchpaths);
+  ci::hmm::evalp_batch<4>(pieces, keepinitial, keeptransition, keepemission, batchlogs);
+  for ( std::size_t i = 0; i < pieces.size(); ++i ) {
+    std::vector<std::size_t> path;
+    if ( !pieces[i].empty() )
+      ci::hmm::viterbi(pieces[i], keepinitial, keeptransition, keepemission, std::back_inserter(path));
+    const float prob = ci::hmm::evalp(pieces[i], keepinitial, keeptransition, keepemission);
+    const bool scored = (pieces[i].size() < 2) ? (batchlogs[i] == ci::inf<float>()) : (prob == std::exp(batchlogs[i]));
+    if ( path != batchpaths[i] || !scored ) {
+      std::cout << "FAILED: batch kernels differ on piece " << i << std::endl;
+      return(1);
+    }
+  } // for
+  std::cout << pieces.size() << " sequences identical" << std::endl;
+
+  // Test the chunked forward algorithm against forward_index()
+  std::cout << "Parallel-in-Time Forward" << std::endl;
+  std::vector<T> longobs;
+  while ( longobs.size() < 20000 )
+    longobs.insert(longobs.end(), observed.begin(), observed.end());
+  std::vector<T> seqalpha(keepinitial.size());
+  std::vector< std::vector<T> > scanalphas;
+  ci::hmm::forward_index(longobs, keepinitial, keeptransition, keepemission, longobs.size(), seqalpha);
+  ci::hmm::forward_scan(longobs, keepinitial, keeptransition, keepemission, 4, scanalphas);
+  std::vector<double> dblobs(longobs.begin(), longobs.end()), dblinitial(keepinitial.begin(), keepinitial.end());
+  std::vector<double> dblalpha(keepinitial.size());
+  std::vector< std::vector<double> > dbltransition, dblemission;
+  for ( std::size_t i = 0; i < keeptransition.size(); ++i ) {
+    dbltransition.push_back(std::vector<double>(keeptransition[i].begin(), keeptransition[i].end()));
+    dblemission.push_back(std::vector<double>(keepemission[i].begin(), keepemission[i].end()));
+  } // for
+  ci::hmm::forward_index(dblobs, dblinitial, dbltransition, dblemission, dblobs.size(), dblalpha);
+  double seqerr = 0, scanerr = 0; // relative to a double-precision forward pass
+  for ( std::size_t i = 0; i < seqalpha.size(); ++i ) {
+    seqerr = std::max(seqerr, std::abs(seqalpha[i] - dblalpha[i]) / std::abs(dblalpha[i]));
+    scanerr = std::max(scanerr, std::abs(scanalphas.back()[i] - dblalpha[i]) / std::abs(dblalpha[i]));
+  } // for
+  std::cout << scanalphas.size() << " chunks" << std::endl;
+  if ( scanalphas.size() != 4 || scanerr > 2 * seqerr + 1e-6 ) {
+    std::cout << "FAILED: forward_scan() rounding error " << scanerr << " vs " << seqerr << std::endl;
+    return(1);
+  }
+
+  std::cout << "Parallel-in-Time Viterbi" << std::endl;
+  std::vector<std::size_t> seqpath, scanpath;
+  ci::hmm::viterbi(longobs, keepinitial, keeptransition, keepemission, std::back_inserter(seqpath));
+  ci::hmm::viterbi_scan(longobs, keepinitial, keeptransition, keepemission, std::back_inserter(scanpath), 4);
+  if ( scanpath != seqpath ) {
+    std::cout << "FAILED: viterbi_scan() differs from viterbi()" << std::endl;
+    return(1);
+  }
+
+  // Test beam kernels: an open beam is exact, a narrow one only loses mass
+  std::cout << "Beam Pruning" << std::endl;
+  {
+    ci::hmm::Workspace<T> ws;
+    ci::hmm::BeamStats open, narrow;
+    std::vector<std::size_t> beampath;
+    std::vector<T> beta(keepinitial.size()), beambeta(keepinitial.size());
+    const float p = ci::hmm::evalp(observed, keepinitial, keeptransition, keepemission);
+    const float q = ci::hmm::evalp_beam(observed, keepinitial, keeptransition, keepemission, ci::hmm::Beam<T>(), open, ws);
+    ci::hmm::viterbi_beam(longobs, keepinitial, keeptransition, keepemission, std::back_inserter(beampath), ci::hmm::Beam<T>(), open, ws);
+    ci::hmm::backward_index(observed, keepinitial, keeptransition, keepemission, 1, beta);
+    ci::hmm::backward_beam(observed, keepinitial, keeptransition, keepemission, 1, beambeta, ci::hmm::Beam<T>(), open, ws);
+    if ( p != q || beampath != seqpath || beta != beambeta || open.dropped != 0 ) {
+      std::cout << "FAILED: open beam differs from the exact kernels" << std::endl;
+      return(1);
+    }
+
+    // log-zero emissions: the open beam never keeps a state that cannot emit
+    const T z = ci::inf<T>();
+    std::vector< std::vector<T> > ztransition = { { -1.2f, -1.5f, -1.4f, -1.45f }, { -1.5f, -1.2f, -1.45f, -1.4f },
+                                                  { -1.4f, -1.45f, -1.2f, -1.5f }, { -1.45f, -1.4f, -1.5f, -1.2f } };
+    std::vector< std::vector<T> > zemission = { { z, -0.9f, -0.5f }, { -1.1f, -1.1f, -1.1f },
+                                                { z, -0.4f, -1.1f }, { -0.2f, z, -1.7f } };
+    std::vector<T> zinitial(4, std::log(0.25f)), zbeta(4), zbeambeta(4);
+    std::vector<std::size_t> zpath, zbeampath;
+    ci::hmm::BeamStats zopen;
+    ci::hmm::viterbi(longobs, zinitial, ztransition, zemission, std::back_inserter(zpath), ws);
+    ci::hmm::viterbi_beam(longobs, zinitial, ztransition, zemission, std::back_inserter(zbeampath), ci::hmm::Beam<T>(), zopen, ws);
+    ci::hmm::backward_index(observed, zinitial, ztransition, zemission, 1, zbeta);
+    ci::hmm::backward_beam(observed, zinitial, ztransition, zemission, 1, zbeambeta, ci::hmm::Beam<T>(), zopen, ws);
+    if ( ci::hmm::evalp(observed, zinitial, ztransition, zemission) !=
+           ci::hmm::evalp_beam(observed, zinitial, ztransition, zemission, ci::hmm::Beam<T>(), zopen, ws)
+         || zbeampath != zpath || zbeta != zbeambeta || zopen.dropped != 0 ) {
+      std::cout << "FAILED: open beam differs from the exact kernels on log-zero emissions" << std::endl;
+      return(1);
+    }
+    const float r = ci::hmm::evalp_beam(observed, keepinitial, keeptransition, keepemission, ci::hmm::Beam<T>(ci::inf<T>(), 1), narrow, ws);
+    std::cout << "top-1 dropped mass " << narrow.dropped << " over " << narrow.columns << " columns" << std::endl;
+    if ( !(r <= p) || narrow.dropped <= 0 || narrow.active != narrow.columns ) {
+      std::cout << "FAILED: top-1 beam" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test int16 Viterbi: agrees with viterbi() but for near-ties; log-zero scores are refused
+  std::cout << "Quantized Viterbi" << std::endl;
+  {
+    ci::hmm::Workspace<T> ws;
+    std::vector<std::size_t> qpath;
+    const ci::hmm::QuantizedModel qmodel(keepinitial, keeptransition, keepemission);
+    if ( !qmodel.Valid() || !ci::hmm::viterbi_quantized(longobs, qmodel, std::back_inserter(qpath), ws) || qpath.size() != seqpath.size() ) {
+      std::cout << "FAILED: quantized model" << std::endl;
+      return(1);
+    }
+    std::size_t differ = 0;
+    for ( std::size_t i = 0; i < qpath.size(); ++i )
+      differ += (qpath[i] != seqpath[i]);
+    std::cout << differ << " of " << qpath.size() << " states differ" << std::endl;
+    std::vector< std::vector<T> > zeroed(keepemission);
+    zeroed[0][0] = ci::inf<T>();
+    if ( differ * 100 > qpath.size() || ci::hmm::QuantizedModel(keepinitial, keeptransition, zeroed).Valid() ) {
+      std::cout << "FAILED: quantized Viterbi" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test every Viterbi variant on a model with log-zero emissions: log-zero
+  //  ranks below every finite score, so no state that cannot emit a symbol
+  //  is reported, and all variants agree with viterbi()
+  std::cout << "Log-Zero Viterbi" << std::endl;
+  {
+    const T z = ci::inf<T>();
+    std::vector<T> zinitial(4, std::log(0.25f));
+    std::vector< std::vector<T> > ztransition = { { -1.2f, -1.5f, -1.4f, -1.45f }, { -1.5f, -1.2f, -1.45f, -1.4f },
+                                                  { -1.4f, -1.45f, -1.2f, -1.5f }, { -1.45f, -1.4f, -1.5f, -1.2f } };
+    std::vector< std::vector<T> > zemission = { { z, -0.9f, -0.5f }, { -1.1f, -1.1f, -1.1f },
+                                                { z, -0.4f, -1.1f }, { -0.2f, z, -1.7f } };
+    ci::hmm::Workspace<T> ws;
+    ci::hmm::BeamStats stats;
+    std::vector<std::size_t> zpath, fxpath, scanpath, beampath, qpath;
+    ci::hmm::viterbi(longobs, zinitial, ztransition, zemission, std::back_inserter(zpath), ws);
+    ci::hmm::viterbi_fixed<4>(longobs, zinitial, ztransition, zemission, std::back_inserter(fxpath));
+    ci::hmm::viterbi_scan(longobs, zinitial, ztransition, zemission, std::back_inserter(scanpath), 4);
+    ci::hmm::viterbi_beam(longobs, zinitial, ztransition, zemission, std::back_inserter(beampath), ci::hmm::Beam<T>(), stats, ws);
+    const ci::hmm::QuantizedModel qmodel(zinitial, ztransition, zemission); // refused; callers use viterbi()
+    bool ok = zpath.size() == longobs.size() && fxpath == zpath && scanpath == zpath && beampath == zpath;
+    ok = ok && !ci::hmm::viterbi_quantized(longobs, qmodel, std::back_inserter(qpath), ws) && qpath.empty();
+    for ( std::size_t s = 0; ok && s < zpath.size(); ++s )
+      ok = zemission[zpath[s]][static_cast<std::size_t>(longobs[s])] != z;
+
+    std::vector< std::vector<T> > pieces;
+    for ( std::size_t i = 0, len = 1; i < 2000; i += len, len = 1 + (len * 7 + 3) % 23 )
+      pieces.push_back(std::vector<T>(longobs.begin() + i, longobs.begin() + i + len));
+    std::vector< std::vector<std::size_t> > batchpaths;
+    ci::hmm::viterbi_batch<4>(pieces, zinitial, ztransition, zemission, batchpaths);
+    for ( std::size_t i = 0; ok && i < pieces.size(); ++i ) {
+      std::vector<std::size_t> path;
+      ci::hmm::viterbi(pieces[i], zinitial, ztransition, zemission, std::back_inserter(path), ws);
+      ok = path == batchpaths[i];
+    } // for
+    if ( !ok ) {
+      std::cout << "FAILED: Viterbi variants disagree on log-zero emissions" << std::endl;
+      return(1);
+    }
+    std::cout << "Identical" << std::endl;
+  }
+
+  // Test per-symbol emitter lists: log-zero emissions are skipped, which must
+  //  match a dense model using a finite stand-in too small to contribute
+  std::cout << "Sparse Emissions" << std::endl;
+  {
+    const T z = ci::inf<T>(), tiny = -1e30f;
+    std::vector<T> spinitial(4, std::log(0.25f)), dninitial(spinitial);
+    std::vector< std::vector<T> > sptransition = { { -1.2f, -1.5f, -1.4f, -1.45f }, { -1.5f, -1.2f, -1.45f, -1.4f },
+                                                   { -1.4f, -1.45f, -1.2f, -1.5f }, { -1.45f, -1.4f, -1.5f, -1.2f } };
+    std::vector< std::vector<T> > spemission = { { -0.5f, -0.9f, z }, { -1.1f, -1.1f, -1.1f },
+                                                 { z, -0.4f, -1.1f }, { -0.2f, z, -1.7f } };
+    std::vector< std::vector<T> > dntransition(sptransition), dnemission(spemission);
+    for ( auto& row : dnemission )
+      std::replace(row.begin(), row.end(), z, tiny);
+
+    // equal, or log-zero where the dense model holds a negligible value
+    auto same = [&](const std::vector< std::vector<T> >& sp, const std::vector< std::vector<T> >& dn) {
+      for ( std::size_t i = 0; i < sp.size(); ++i )
+        for ( std::size_t j = 0; j < sp[i].size(); ++j )
+          if ( sp[i][j] != dn[i][j] && !(sp[i][j] == z && dn[i][j] < tiny / 2) )
+            return(false);
+      return(true);
+    };
+
+    ci::hmm::Workspace<T> spws, dnws;
+    bool ok = ci::hmm::evalp(observed, spinitial, sptransition, spemission, spws) ==
+              ci::hmm::evalp(observed, dninitial, dntransition, dnemission, dnws);
+    auto ftransition(sptransition), femission(spemission), gtransition(dntransition), gemission(dnemission);
+    auto finitial(spinitial), ginitial(dninitial);
+    ci::hmm::train(observed, spinitial, sptransition, spemission, spws);
+    ci::hmm::train(observed, dninitial, dntransition, dnemission, dnws);
+    ci::hmm::train_full(observed, finitial, ftransition, femission, spws);
+    ci::hmm::train_full(observed, ginitial, gtransition, gemission, dnws);
+    ok = ok && same(sptransition, dntransition) && same(spemission, dnemission);
+    ok = ok && same(ftransition, gtransition) && same(femission, gemission);
+    if ( !ok ) {
+      std::cout << "FAILED: sparse emissions differ from dense" << std::endl;
+      return(1);
+    }
+    std::cout << "Identical" << std::endl;
+  }
+
+  // Test sparse emission rows against dense rows over a large alphabet of
+  //  which only the first 3 symbols are ever observed
+  std::cout << "Sparse Emission Rows" << std::endl;
+  {
+    const T z = ci::inf<T>();
+    const std::size_t nsymbols = 1000;
+    std::vector< std::vector<T> > dnemission = { { -0.5f, -0.9f, z }, { -1.1f, -1.1f, -1.1f },
+                                                 { z, -0.4f, -1.1f }, { -0.2f, z, -1.7f } };
+    std::vector< ci::hmm::SparseRow<T> > spemission(dnemission.size(), ci::hmm::SparseRow<T>(nsymbols));
+    for ( std::size_t j = 0; j < dnemission.size(); ++j ) {
+      for ( std::size_t m = 0; m < dnemission[j].size(); ++m )
+        if ( dnemission[j][m] != z )
+          spemission[j].Set(m, dnemission[j][m]);
+      dnemission[j].resize(nsymbols, z);
+    } // for
+    std::vector<T> spinitial(4, std::log(0.25f)), dninitial(spinitial);
+    std::vector< std::vector<T> > sptransition = { { -1.2f, -1.5f, -1.4f, -1.45f }, { -1.5f, -1.2f, -1.45f, -1.4f },
+                                                   { -1.4f, -1.45f, -1.2f, -1.5f }, { -1.45f, -1.4f, -1.5f, -1.2f } };
+    std::vector< std::vector<T> > dntransition(sptransition);
+
+    auto same = [&]() {
+      std::size_t stored = 0;
+      for ( std::size_t j = 0; j < dnemission.size(); ++j ) {
+        stored += spemission[j].Stored();
+        for ( std::size_t m = 0; m < nsymbols; ++m )
+          if ( spemission[j][m] != dnemission[j][m] )
+            return(false);
+      } // for
+      return(stored <= 3 * dnemission.size() && spinitial == dninitial && sptransition == dntransition);
+    };
+
+    ci::hmm::Workspace<T> spws, dnws;
+    std::vector<std::size_t> sppath, dnpath;
+    bool ok = ci::hmm::evalp_auto(observed, spinitial, sptransition, spemission, spws) ==
+              ci::hmm::evalp_auto(observed, dninitial, dntransition, dnemission, dnws);
+    ci::hmm::viterbi_auto(observed, spinitial, sptransition, spemission, std::back_inserter(sppath), spws);
+    ci::hmm::viterbi_auto(observed, dninitial, dntransition, dnemission, std::back_inserter(dnpath), dnws);
+    ok = ok && sppath == dnpath;
+    for ( std::size_t i = 0; ok && i < 3; ++i ) {
+      ci::hmm::train_auto(observed, spinitial, sptransition, spemission, spws);
+      ci::hmm::train_auto(observed, dninitial, dntransition, dnemission, dnws);
+      ok = same();
+    } // for
+    ci::hmm::train_full(observed, spinitial, sptransition, spemission, spws);
+    ci::hmm::train_full(observed, dninitial, dntransition, dnemission, dnws);
+    ok = ok && same();
+    if ( !ok ) {
+      std::cout << "FAILED: sparse emission rows differ from dense" << std::endl;
+      return(1);
+    }
+    std::cout << "Identical" << std::endl;
+  }
+
+  // Test backward segments recomputed ahead on a helper thread
+  std::cout << "Prefetched Backward Segments" << std::endl;
+  {
+    std::vector< std::vector<T> > betas(keepinitial.size(), std::vector<T>(longobs.size(), 0));
+    ci::hmm::backward_full(longobs, keepinitial, keeptransition, keepemission, 1, betas);
+    ci::hmm::Workspace<T> ws;
+    ci::hmm::details::BackCache< FOO, FOO, std::vector<FOO>, std::vector<FOO>, T >
+                    cache(longobs, keepinitial, keeptransition, keepemission, ci::hmm::exact_logsum(), &ws);
+    bool ok = true;
+    std::size_t s = 0;
+    for ( FOO const* b = 0; s < longobs.size() && (b = cache.Next()); ++s ) {
+      for ( std::size_t i = 0; i < b->size(); ++i )
+        ok = ok && (*b)[i] == betas[i][s];
+      cache.Release(b);
+    } // for
+
+    std::vector<T> fxinitial(keepinitial), lginitial(keepinitial);
+    std::vector< std::vector<T> > fxtransition(keeptransition), fxemission(keepemission);
+    std::vector< std::vector<T> > lgtransition(keeptransition), lgemission(keepemission);
+    ci::hmm::train_auto(longobs, fxinitial, fxtransition, fxemission, ws);
+    ci::hmm::train(longobs, lginitial, lgtransition, lgemission, ws);
+    ok = ok && fxinitial == lginitial && fxtransition == lgtransition && fxemission == lgemission;
+    std::cout << s << " columns" << std::endl;
+    if ( !ok || s != longobs.size() ) {
+      std::cout << "FAILED: prefetched segments differ from a serial backward pass" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test online EM: a model streamed in blocks must reload
+  std::cout << "Online Training" << std::endl;
+  {
+    std::vector<T> oninitial(keepinitial);
+    std::vector< std::vector<T> > ontransition(keeptransition), onemission(keepemission);
+    for ( std::size_t i = 0; i < oninitial.size(); ++i ) // lopsided start; OnlineEM takes it in log space
+      oninitial[i] = std::log(0.8f - 0.6f * i);
+    ci::hmm::OnlineEM< std::vector<T>, std::vector< std::vector<T> >, std::vector< std::vector<T> > >
+                     em(oninitial, ontransition, onemission);
+    for ( std::size_t pos = 0, len = 16000; pos < longobs.size(); pos += len, len = 1000 )
+      em.Update(std::vector<T>(longobs.begin() + pos, longobs.begin() + std::min(pos + len, longobs.size())));
+    em.Finish();
+    std::cout << em.Blocks() << " blocks" << std::endl;
+    if ( em.Blocks() < 2 || !reloads(oninitial, ontransition, onemission) ) {
+      std::cout << "FAILED: online training" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test that every training engine writes a model that reloads
+  std::cout << "Training Engines" << std::endl;
+  {
+    std::vector< std::vector<T> > initials(5, keepinitial);
+    std::vector< std::vector< std::vector<T> > > transitions(5, keeptransition), emissions(5, keepemission);
+    ci::hmm::Workspace<T> ws;
+    ci::hmm::train_full(longobs, initials[0], transitions[0], emissions[0], ws);
+    ci::hmm::train(longobs, initials[1], transitions[1], emissions[1], ws);
+    ci::hmm::train_mem(longobs, initials[2], transitions[2], emissions[2]);
+    ci::hmm::train_split(longobs, initials[3], transitions[3], emissions[3], ws);
+    ci::hmm::train_auto(longobs, initials[4], transitions[4], emissions[4], ws);
+    for ( std::size_t e = 0; e < initials.size(); ++e ) {
+      if ( !reloads(initials[e], transitions[e], emissions[e], 1e-3) ) {
+        std::cout << "FAILED: engine " << e << " writes a model that does not reload" << std::endl;
+        return(1);
+      }
+    } // for
+  }
+
+  // Test per-record E-steps: statistics must not depend on the number of threads
+  std::cout << "Deterministic Reductions" << std::endl;
+  {
+    std::vector< std::vector<T> > pieces;
+    for ( std::size_t pos = 0, len = 50; pos < longobs.size(); pos += len, len = 50 + (len * 7) % 300 )
+      pieces.push_back(std::vector<T>(longobs.begin() + pos, longobs.begin() + std::min(pos + len, longobs.size())));
+    ci::hmm::Statistics<T> one(keepinitial.size(), keepemission[0].size());
+    ci::hmm::estep_records(pieces, keepinitial, keeptransition, keepemission, one, 1);
+    bool ok = (one.nsequences == pieces.size());
+    for ( std::size_t t : { 2, 3, 8 } ) {
+      ci::hmm::Statistics<T> many(keepinitial.size(), keepemission[0].size());
+      ci::hmm::estep_records(pieces, keepinitial, keeptransition, keepemission, many, t);
+      ok = ok && many.loglik == one.loglik && many.initial == one.initial && many.denominator == one.denominator
+              && many.numeratorT == one.numeratorT && many.numeratorE == one.numeratorE;
+    } // for
+    std::cout << pieces.size() << " records" << std::endl;
+    if ( !ok ) {
+      std::cout << "FAILED: statistics depend on the number of threads" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test Merge() against estep_records(), and a statistics file round trip
+  std::cout << "Statistics Files" << std::endl;
+  {
+    const std::size_t nstates = keepinitial.size(), nsymbols = keepemission[0].size();
+    const std::vector<T> first(longobs.begin(), longobs.begin() + 3000), second(longobs.begin() + 3000, longobs.begin() + 7000);
+    ci::hmm::Statistics<T> a(nstates, nsymbols), b(a), records(a), back;
+    ci::hmm::estep(first, keepinitial, keeptransition, keepemission, a);
+    ci::hmm::estep(second, keepinitial, keeptransition, keepemission, b);
+    a.Merge(b);
+    ci::hmm::estep_records(std::vector< std::vector<T> >{ first, second }, keepinitial, keeptransition, keepemission, records, 1);
+    bool ok = a.nsequences == 2 && a.nsequences == records.nsequences && a.loglik == records.loglik
+              && a.initial == records.initial && a.denominator == records.denominator
+              && a.numeratorT == records.numeratorT && a.numeratorE == records.numeratorE;
+
+    std::stringstream file;
+    ci::hmm::write_statistics(file, a);
+    ci::hmm::read_statistics(file, back, "merged");
+    ok = ok && back.nsequences == a.nsequences && back.loglik == a.loglik && back.initial == a.initial
+            && back.denominator == a.denominator && back.numeratorT == a.numeratorT && back.numeratorE == a.numeratorE;
+
+    // unseen symbols stay unallocated; a truncated file is refused
+    ci::hmm::Statistics<T> sparse(nstates, 5), sparseback;
+    sparse.nsequences = 1, sparse.Symbol(3)[1] = -1.5f;
+    std::stringstream sparsefile;
+    ci::hmm::write_statistics(sparsefile, sparse);
+    ci::hmm::read_statistics(sparsefile, sparseback, "sparse");
+    ok = ok && sparseback.NSymbols() == 5 && sparseback.numeratorE[0].empty() && sparseback.numeratorE[3] == sparse.numeratorE[3];
+    const std::string bytes = sparsefile.str();
+    std::istringstream truncated(bytes.substr(0, bytes.size() - 1));
+    try {
+      ci::hmm::read_statistics(truncated, back, "truncated");
+      ok = false;
+    } catch(const std::string&) { }
+
+    // a state never seen first gets initial probability 0, not exp(inf)
+    std::vector<T> msinitial(keepinitial);
+    std::vector< std::vector<T> > mstransition(keeptransition), msemission(keepemission);
+    a.initial[1] = ci::inf<T>();
+    ci::hmm::mstep(a, msinitial, mstransition, msemission);
+    ok = ok && msinitial[0] == 1 && msinitial[1] == 0;
+    if ( !ok ) {
+      std::cout << "FAILED: statistics files" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test the two-thread E-step: same statistics as estep() up to rounding in the sums
+  std::cout << "Two-Thread E-Step" << std::endl;
+  {
+    ci::hmm::Workspace<T> ws;
+    ci::hmm::Statistics<T> serial(keepinitial.size(), keepemission[0].size()), split(serial);
+    ci::hmm::estep(longobs, keepinitial, keeptransition, keepemission, serial, ws);
+    ci::hmm::estep_split(longobs, keepinitial, keeptransition, keepemission, split, ws);
+    double maxdiff = std::abs(serial.loglik - split.loglik) / longobs.size();
+    for ( std::size_t i = 0; i < keepinitial.size(); ++i ) {
+      maxdiff = std::max(maxdiff, static_cast<double>(std::abs(serial.initial[i] - split.initial[i])));
+      maxdiff = std::max(maxdiff, static_cast<double>(std::abs(serial.denominator[i] - split.denominator[i])));
+      for ( std::size_t j = 0; j < keepinitial.size(); ++j )
+        maxdiff = std::max(maxdiff, static_cast<double>(std::abs(serial.numeratorT[i][j] - split.numeratorT[i][j])));
+      for ( std::size_t m = 0; m < keepemission[0].size(); ++m )
+        maxdiff = std::max(maxdiff, static_cast<double>(std::abs(serial.Symbol(m)[i] - split.Symbol(m)[i])));
+    } // for
+    std::cout << "max difference " << maxdiff << std::endl;
+    if ( split.nsequences != 1 || maxdiff > 1e-3 ) {
+      std::cout << "FAILED: estep_split() differs from estep() by " << maxdiff << std::endl;
+      return(1);
+    }
+  }
+
+  // Test state masks: paths stay inside the mask, skipped states match a dense
+  //  stand-in too small to contribute, and an empty mask changes nothing
+  std::cout << "State Masks" << std::endl;
+  {
+    const T tiny = -1e30f;
+    const std::size_t nsymbols = keepemission[0].size();
+    ci::hmm::StateMask mask(keepinitial.size(), longobs.size()), none(keepinitial.size(), longobs.size());
+    mask.Allow(100, 600, { 0 });
+    mask.Allow(400, 900, { 0, 1 }); // [400, 600) stays { 0 }; [600, 900) is every state, set 0
+    mask.Allow(5000, 5001, { 1 });
+    ci::hmm::PackedSequence<T> masked, plain;
+    std::vector< std::vector<T> > memission, dnemission;
+    ci::hmm::mask_sequence(longobs, mask, nsymbols, masked);
+    ci::hmm::mask_sequence(longobs, none, nsymbols, plain);
+    ci::hmm::mask_emission(keepemission, mask, memission);
+    dnemission = memission;
+    for ( auto& row : dnemission )
+      std::replace(row.begin(), row.end(), ci::inf<T>(), tiny);
+
+    ci::hmm::Workspace<T> ws;
+    std::vector<std::size_t> mpath, dnpath;
+    ci::hmm::viterbi(masked, keepinitial, keeptransition, memission, std::back_inserter(mpath), ws);
+    ci::hmm::viterbi(masked, keepinitial, keeptransition, dnemission, std::back_inserter(dnpath), ws);
+    bool ok = mask.NSets() == 3 && mpath == dnpath;
+    for ( std::size_t s = 0; ok && s < mpath.size(); ++s ) {
+      const std::vector<std::size_t>& allowed = mask.Set(mask[s]);
+      ok = std::find(allowed.begin(), allowed.end(), mpath[s]) != allowed.end();
+    } // for
+
+    std::vector<T> malpha(keepinitial.size()), dnalpha(keepinitial.size());
+    ci::hmm::forward_index(masked, keepinitial, keeptransition, memission, masked.size(), malpha, ws);
+    ci::hmm::forward_index(masked, keepinitial, keeptransition, dnemission, masked.size(), dnalpha, ws);
+    T mlogp = ci::inf<T>(), dnlogp = ci::inf<T>();
+    for ( std::size_t i = 0; i < malpha.size(); ++i )
+      mlogp = ci::hmm::elnsum(mlogp, malpha[i]), dnlogp = ci::hmm::elnsum(dnlogp, dnalpha[i]);
+    ok = ok && mlogp == dnlogp;
+
+    std::vector<T> minitial(keepinitial), tinitial(keepinitial);
+    std::vector< std::vector<T> > mtransition(keeptransition), memis(keepemission);
+    std::vector< std::vector<T> > ttransition(keeptransition), temission(keepemission);
+    ci::hmm::train_masked(plain, none, minitial, mtransition, memis, ws);
+    ci::hmm::train(longobs, tinitial, ttransition, temission, ws);
+    ok = ok && minitial == tinitial && mtransition == ttransition && memis == temission;
+    const double unconstrained = ws.stats.loglik;
+    minitial = keepinitial, mtransition = keeptransition, memis = keepemission;
+    ci::hmm::train_masked(masked, mask, minitial, mtransition, memis, ws);
+    ok = ok && ws.stats.loglik < unconstrained && memis[0].size() == nsymbols;
+    std::cout << mask.Allowed() << " of " << mask.size() * mask.NStates() << " state-positions allowed" << std::endl;
+    if ( !ok ) {
+      std::cout << "FAILED: state masks" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test time-major trellises, in RAM and in a file, against forward_index() and each other
+  std::cout << "Time-Major Trellis" << std::endl;
+  {
+    ci::hmm::Workspace<T> ws, fws;
+    ci::hmm::Trellis<T> alpha;
+    std::vector<T> last(keepinitial.size());
+    ci::hmm::forward_full(longobs, keepinitial, keeptransition, keepemission, longobs.size(), alpha, ws);
+    ci::hmm::forward_index(longobs, keepinitial, keeptransition, keepemission, longobs.size(), last, ws);
+    bool ok = alpha.Rows() == longobs.size() && std::equal(last.begin(), last.end(), alpha[longobs.size()-1]);
+
+    fws.Backing("/tmp", 0);
+    std::vector<T> initial(keepinitial), finitial(keepinitial);
+    std::vector< std::vector<T> > transition(keeptransition), emission(keepemission);
+    std::vector< std::vector<T> > ftransition(keeptransition), femission(keepemission);
+    ci::hmm::train_full(longobs, initial, transition, emission, ws);
+    ci::hmm::train_full(longobs, finitial, ftransition, femission, fws);
+    ok = ok && fws.xiT.Mapped() && !ws.xiT.Mapped();
+    ok = ok && initial == finitial && transition == ftransition && emission == femission;
+    std::cout << fws.xiT.Rows() << " x " << fws.xiT.Width() << " xi values file-backed" << std::endl;
+    if ( !ok ) {
+      std::cout << "FAILED: time-major trellis" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test bit-packed observations against the same symbols held as floats
+  std::cout << "Packed Observations" << std::endl;
+  {
+    ci::hmm::PackedSequence<T> packed;
+    for ( std::size_t s = 0; s < longobs.size(); ++s )
+      packed.push_back(static_cast<std::size_t>(longobs[s]));
+    const std::size_t bits = packed.Bits();
+    packed.push_back(300); // widens to 16 bits; earlier symbols must survive
+    std::vector<std::size_t> unpacked;
+    packed.Decode(3, longobs.size(), std::back_inserter(unpacked));
+    bool ok = packed.Bits() == 16 && packed[longobs.size()] == 300 && unpacked.size() == longobs.size() - 3;
+    for ( std::size_t s = 0; ok && s < unpacked.size(); ++s )
+      ok = unpacked[s] == longobs[s + 3] && packed[s + 3] == longobs[s + 3];
+
+    ci::hmm::PackedSequence<T>::Slice slice = packed.Sub(0, longobs.size());
+    std::vector<std::size_t> pkpath;
+    ci::hmm::viterbi(slice, keepinitial, keeptransition, keepemission, std::back_inserter(pkpath));
+    std::vector<T> pkinitial(keepinitial), lginitial(keepinitial);
+    std::vector< std::vector<T> > pktransition(keeptransition), pkemission(keepemission);
+    std::vector< std::vector<T> > lgtransition(keeptransition), lgemission(keepemission);
+    ci::hmm::train(slice, pkinitial, pktransition, pkemission);
+    ci::hmm::train(longobs, lginitial, lgtransition, lgemission);
+    ok = ok && pkpath == seqpath && pkinitial == lginitial && pktransition == lgtransition && pkemission == lgemission;
+    ok = ok && ci::hmm::evalp(slice, keepinitial, keeptransition, keepemission)
+                == ci::hmm::evalp(longobs, keepinitial, keeptransition, keepemission);
+    std::cout << bits << " bits per symbol, " << packed.Bytes() << " bytes" << std::endl;
+    if ( !ok ) {
+      std::cout << "FAILED: packed observations differ" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test fast log-add engine against elnsum()
+  std::cout << "Fast Log-Sum" << std::endl;
+  ci::hmm::fast_logsum fastsum;
+  double maxerr = 0;
+  for ( int i = -4000; i <= 4000; ++i ) { // |x-y| in [0, ~20], mostly off the table grid
+    const double x = -3.7, y = x + i / 197.0;
+    maxerr = std::max(maxerr, std::abs(fastsum(x, y) - ci::hmm::elnsum(x, y)));
+  } // for
+  std::cout << "Max abs error: " << maxerr << " (bound " << ci::hmm::fast_logsum::bound << ")" << std::endl;
+  if ( maxerr > ci::hmm::fast_logsum::bound ) {
+    std::cout << "FAILED: fast_logsum error bound" << std::endl;
+    return(1);
+  }
+  if ( fastsum(ci::inf<T>(), ci::inf<T>()) != ci::inf<T>() || fastsum(ci::inf<T>(), T(-2)) != T(-2) ) {
+    std::cout << "FAILED: fast_logsum log-zero handling" << std::endl;
+    return(1);
+  }
+
+  // Test the request server over pipes: every request is answered once, by some worker
+  std::cout << "Serving" << std::endl;
+  {
+    int in[2], out[2];
+    if ( ::pipe(in) != 0 || ::pipe(out) != 0 ) {
+      std::cout << "FAILED: pipe()" << std::endl;
+      return(1);
+    }
+    std::string requests;
+    for ( int i = 0; i < 200; ++i )
+      requests += std::to_string(i) + "\n";
+    if ( ::write(in[1], requests.data(), requests.size()) != static_cast<ssize_t>(requests.size()) )
+      return(1);
+    ::close(in[1]);
+
+    ci::hmm::LatencyHistogram latency;
+    {
+      ci::hmm::Server server([&](std::size_t, const std::string& r) {
+                               latency.Record(std::chrono::microseconds(std::stoi(r)));
+                               return("=" + r);
+                             }, 4);
+      server.Serve(in[0], out[1]);
+    }
+    ::close(in[0]), ::close(out[1]);
+    std::string responses;
+    char buf[4096];
+    for ( ssize_t n = 0; (n = ::read(out[0], buf, sizeof(buf))) > 0; )
+      responses.append(buf, n);
+    ::close(out[0]);
+    std::vector<int> seen(200, 0);
+    std::istringstream is(responses);
+    for ( std::string line; std::getline(is, line); )
+      ++seen[std::stoi(line.substr(1))];
+    std::cout << latency.Count() << " requests; p50 <= " << latency.Quantile(0.5) << "us" << std::endl;
+    if ( std::count(seen.begin(), seen.end(), 1) != 200 || latency.Count() != 200 || latency.Quantile(0.5) != 128 ) {
+      std::cout << "FAILED: server" << std::endl;
+      return(1);
+    }
+
+    // probability requests as rHMM serve answers them: <id> <symbols>; one symbol
+    //  scores ln(sum_i initial_i emission_i(symbol)), not log-zero
+    if ( ::pipe(in) != 0 || ::pipe(out) != 0 ) {
+      std::cout << "FAILED: pipe()" << std::endl;
+      return(1);
+    }
+    requests = "one\t1\nmany\t1 0 0 1\nnone\t\n";
+    if ( ::write(in[1], requests.data(), requests.size()) != static_cast<ssize_t>(requests.size()) )
+      return(1);
+    ::close(in[1]);
+    {
+      std::vector< ci::hmm::Workspace<T> > ws(2);
+      ci::hmm::Server server([&](std::size_t w, const std::string& r) {
+                               const std::size_t tab = r.find('\t');
+                               std::vector<T> symbols;
+                               std::istringstream is(r.substr(tab + 1));
+                               for ( T m; is >> m; )
+                                 symbols.push_back(m);
+                               std::ostringstream os;
+                               os.precision(9);
+                               os << r.substr(0, tab) << "\t" << ci::hmm::log_evalp(symbols, keepinitial, keeptransition, keepemission, ws[w]);
+                               return(os.str());
+                             }, 2);
+      server.Serve(in[0], out[1]);
+    }
+    ::close(in[0]), ::close(out[1]);
+    responses.clear();
+    for ( ssize_t n = 0; (n = ::read(out[0], buf, sizeof(buf))) > 0; )
+      responses.append(buf, n);
+    ::close(out[0]);
+    const std::vector<T> many = { 1, 0, 0, 1 };
+    double one = 0;
+    for ( std::size_t i = 0; i < keepinitial.size(); ++i )
+      one += std::exp(keepinitial[i] + keepemission[i][1]);
+    std::map<std::string, double> answers;
+    std::istringstream ps(responses);
+    for ( std::string id, value; ps >> id >> value; )
+      answers[id] = (value == "inf") ? ci::inf<double>() : std::stod(value);
+    if ( answers.size() != 3 || std::abs(answers["one"] - std::log(one)) > 1e-5 || answers["none"] != ci::inf<double>()
+                             || std::abs(answers["many"] - std::log(ci::hmm::evalp(many, keepinitial, keeptransition, keepemission))) > 1e-5 ) {
+      std::cout << "FAILED: probability requests" << std::endl;
+      return(1);
+    }
+
+    // a line over maxline bytes is answered by Overlong and the rest of it skipped
+    if ( ::pipe(in) != 0 || ::pipe(out) != 0 ) {
+      std::cout << "FAILED: pipe()" << std::endl;
+      return(1);
+    }
+    requests = "long\t" + std::string(100, 'x') + "\nshort\tx\n";
+    if ( ::write(in[1], requests.data(), requests.size()) != static_cast<ssize_t>(requests.size()) )
+      return(1);
+    ::close(in[1]);
+    {
+      ci::hmm::Server server([](std::size_t, const std::string& r) { return("=" + r); }, 2, 16,
+                             [](const std::string& head) { return("!" + head); });
+      server.Serve(in[0], out[1]);
+    }
+    ::close(in[0]), ::close(out[1]);
+    responses.clear();
+    for ( ssize_t n = 0; (n = ::read(out[0], buf, sizeof(buf))) > 0; )
+      responses.append(buf, n);
+    ::close(out[0]);
+    if ( responses != "!long\t" + std::string(11, 'x') + "\n=short\tx\n" ) {
+      std::cout << "FAILED: overlong request: " << responses << std::endl;
+      return(1);
+    }
+
+    // socket clients one after another: finished readers are joined, so the
+    //  address space does not grow by a thread stack per client; and running
+    //  out of descriptors holds a client back rather than ending Listen()
+    const std::string path = "/tmp/rHMM-test1-" + std::to_string(::getpid());
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    auto vmsize = []() {
+      std::ifstream status("/proc/self/status");
+      std::size_t kb = 0;
+      for ( std::string key; status >> key; )
+        if ( key == "VmSize:" && (status >> kb) )
+          break;
+      return(kb);
+    };
+    auto reply = [&](int fd, const std::string& request) {
+      std::string r;
+      if ( ::send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size()) ) {
+        ::shutdown(fd, SHUT_WR);
+        for ( ssize_t n = 0; (n = ::read(fd, buf, sizeof(buf))) > 0; )
+          r.append(buf, n);
+      }
+      return(r);
+    };
+    auto client = [&](const std::string& request) {
+      const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      for ( int tries = 0; tries < 100 && ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0; ++tries )
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      const std::string r = reply(fd, request);
+      ::close(fd);
+      return(r);
+    };
+
+    ci::hmm::Server server([](std::size_t, const std::string& r) { return("=" + r); }, 2);
+    std::thread listener([&]() { server.Listen(path); });
+    bool ok = (client("0\n") == "=0\n");
+    std::size_t before = vmsize();
+    for ( int i = 1; ok && i <= 100; ++i ) {
+      ok = (client(std::to_string(i) + "\n") == "=" + std::to_string(i) + "\n");
+      if ( 10 == i )
+        before = vmsize();
+    } // for
+    const std::size_t after = vmsize();
+    std::cout << "100 clients; address space grew " << (after - std::min(before, after)) << " kB" << std::endl;
+
+    rlimit limit;
+    std::string held;
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if ( ok && fd >= 0 && ::getrlimit(RLIMIT_NOFILE, &limit) == 0 ) {
+      rlimit none = limit;
+      none.rlim_cur = ::dup(0); // every lower descriptor is open, so accept() fails with EMFILE
+      ::close(none.rlim_cur);
+      ::setrlimit(RLIMIT_NOFILE, &none);
+      const bool connected = (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+      std::this_thread::sleep_for(std::chrono::milliseconds(300));
+      ::setrlimit(RLIMIT_NOFILE, &limit);
+      held = connected ? reply(fd, "x\n") : "";
+    }
+    if ( fd >= 0 )
+      ::close(fd);
+    server.Stop();
+    listener.join();
+    if ( !ok || after - std::min(before, after) > 64 * 1024 || held != "=x\n" ) {
+      std::cout << "FAILED: socket clients" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test hardware counters: whichever open must count, the rest must say so
+  std::cout << "Performance Counters" << std::endl;
+  {
+    typedef ci::hmm::PerfCounters PC;
+    PC counters;
+    counters.Start();
+    float sum = 0;
+    for ( std::size_t i = 0; i < longobs.size(); ++i )
+      sum = ci::hmm::elnsum(sum, longobs[i]);
+    const PC::Sample s = counters.Stop();
+    bool ok = (s.seconds >= 0) && (sum == sum);
+    for ( int e = 0; e < PC::NEVENTS; ++e )
+      ok = ok && (s.Valid(PC::Event(e)) ? (counters.Valid(PC::Event(e)) && (e > PC::INSTRUCTIONS || s.count[e] > 0)) : !s.count[e]);
+    ok = ok && (counters.Unavailable().empty() == (counters.Valid(PC::CYCLES) && counters.Valid(PC::INSTRUCTIONS) &&
+                                                  counters.Valid(PC::CACHE_MISSES) && counters.Valid(PC::BRANCH_MISSES)));
+    if ( !ok ) {
+      std::cout << "FAILED: performance counters" << std::endl;
+      return(1);
+    }
+  }
+
+  // Test segment output against the per-position states
+  std::cout << "Segment Output" << std::endl;
+  std::ostringstream segments, expected;
+  {
+    ci::hmm::AsyncWriter writer(segments, ci::hmm::AsyncWriter::MinSize); // forces many handoffs
+    ci::hmm::DecodeWriter decoded(writer, ci::hmm::DecodeWriter::Format::SEGMENTS);
+    std::size_t pos = 0;
+    for ( std::size_t run = 0; run < 200; ++run ) {
+      const std::size_t len = 1 + run % 7, state = run % 3;
+      expected << pos << "\t" << pos + len << "\t" << state << "\n";
+      for ( std::size_t i = 0; i < len; ++i, ++pos )
+        decoded(state);
+    } // for
+    decoded.Finish();
+  }
+  const std::string written = segments.str();
+  std::cout << std::count(written.begin(), written.end(), '\n') << " segments" << std::endl;
+  if ( written != expected.str() ) {
+    std::cout << "FAILED: segment output" << std::endl;
+    return(1);
+  }
+
   return(0);
 }
@@ -1,17 +1,26 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <condition_variable>
 #include <cstddef>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
 #include <cstdio> /* NULL */
 #include <cstdlib>
 #include <ctime>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <mutex>
 #include <numeric>
 #include <set>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include "hmm.hpp"
@@ -78,20 +87,68 @@ void do_exp(std::vector<T>& v) {
 std::string Usage(std::string s) {
   std::string msg = s + "\n\nUSAGE:";
   msg += "\n0) --help or --version";
-  msg += "\n1) train [--verbose] [--seed=<+integer>] <number-states> <number-iterations> <observations-file>";
-  msg += "\n2) probability <hmm-parameters-file> <observations-file>";
-  msg += "\n3) decode <hmm-parameters-file> <observations-file>";
-  msg += "\n4) train-and-decode [--verbose] [--seed=<+integer>] <number-states> <number-iterations> <observations-file>";
+  msg += "\n1) train [--verbose] [--seed=<+integer>] [--fast-iterations=<+integer>] [--engine=auto|full|standard|mem|split] [--mem-budget=<size>] [--plan]";
+  msg += "\n     [--trellis-dir=<dir>] [--mask=<file>] <number-states> <number-iterations> <observations-file>";
+  msg += "\n2) probability [--threads=<+integer>] [--beam=<+real>] [--top-k=<+integer>] [--mask=<file>] <hmm-parameters-file> <observations-file>";
+  msg += "\n3) decode [--format=states|segments|bed] [--chrom=<name>] [--threads=<+integer>] [--beam=<+real>] [--top-k=<+integer>]";
+  msg += "\n     [--precision=float|int16] [--mask=<file>] <hmm-parameters-file> <observations-file>";
+  msg += "\n4) train-and-decode [--verbose] [--seed=<+integer>] [--fast-iterations=<+integer>] [--engine=auto|full|standard|mem|split] [--mem-budget=<size>] [--plan]";
+  msg += "\n     [--trellis-dir=<dir>] [--format=states|segments|bed] [--chrom=<name>] [--threads=<+integer>] [--mask=<file>]";
+  msg += "\n     <number-states> <number-iterations> <observations-file>";
+  msg += "\n5) train-online [--verbose] [--seed=<+integer>] [--block-size=<+integer>] <number-states> <observations-file>";
+  msg += "\n6) estep [--threads=<+integer>] <hmm-parameters-file> <observations-file>";
+  msg += "\n7) mstep <hmm-parameters-file> <statistics-file>...";
+  msg += "\n8) serve [--threads=<+integer>] [--socket=<path>] <hmm-parameters-file>...";
+  msg += "\n9) profile <hmm-parameters-file> <observations-file>";
   msg += "\n\nAll output is sent to stdout.";
   msg += "\nYou can train a discrete hmm, save its output, and then use it as an <hmm-parameters-file> to";
   msg += "\ndetermine the probability of another set of observations, or to decode the hidden states";
   msg += "\nof another set of observations.";
   msg += "\nYou can also train an hmm on observations and decode the hidden states of that";
   msg += "\ninformation using train-and-decode.";
+  msg += "\ntrain-online makes a single pass over the observations in fixed-size blocks using stepwise EM;";
+  msg += "\nmemory does not grow with the number of observations.  Use - as <observations-file> to read stdin.";
+  msg += "\nestep writes binary training statistics for one shard of observations; mstep merges any";
+  msg += "\nnumber of those files into the next model.  Together they make one train iteration.";
+  msg += "\nestep treats each '>' record as an independent sequence, run on --threads threads (default: all";
+  msg += "\ncores); the statistics are bit-identical for any number of threads.";
+  msg += "\nserve loads models once and answers one tab-separated request per line, on stdin or on a Unix";
+  msg += "\nsocket at --socket, using --threads workers:  <id> decode|probability <model> <observations>";
+  msg += "\nor <id> stats.  <model> is a parameters file as given, or its 0-based position.  Responses come";
+  msg += "\nin completion order: <id> <states>, <id> <natural-log-probability>, <id> <latency summaries>";
+  msg += "\nor <id> error <message>.  Requests over 64 MB get an error.  Latency histograms go to stderr on exit.";
+  msg += "\nprofile runs each kernel phase once over the observations and reports time, hardware counters,";
+  msg += "\nIPC and misses per symbol-state.  Counters the system refuses are reported as n/a.";
+  msg += "\n--format selects decoded output: states (default) writes one state per observation;";
+  msg += "\nsegments writes one <start> <end> <state> line per run of identical states (0-based, half-open);";
+  msg += "\nbed is segments with a leading name column, given by --chrom (default: the observations-file name).";
+  msg += "\nA line starting with '>' begins a new record named by its first word.  decode treats records";
+  msg += "\nas separate sequences and decodes them concurrently on --threads threads (default: all cores);";
+  msg += "\noutput stays in input order.  states and segments output then begin each record with its '>' line.";
+  msg += "\nA single long sequence is split in time across the threads only when --threads is given, for decode";
+  msg += "\nand probability; results then match one thread up to rounding, and --threads>1 can flip decoded";
+  msg += "\nstates where two states nearly tie.  Without --threads a single sequence runs on one thread.";
+  msg += "\nprobability prints one <name> <log-probability> line per record.  The other operations concatenate all records.";
+  msg += "\n--beam and --top-k make probability and decode approximate: at each step only states within <+real>";
+  msg += "\n(natural log) of the best one, and at most <+integer> of them, are carried forward.  The mass dropped";
+  msg += "\nis reported on stderr.";
+  msg += "\n--precision=int16 decodes with scores rounded to 16-bit integers, which is faster; states match";
+  msg += "\nfloat (the default) except at near-ties.  Models with log-zero scores are decoded in float.";
+  msg += "\n--mask restricts the states allowed at positions: each line of <file> is <start> <end> <state>[,<state>...]";
+  msg += "\n(0-based, half-open positions over all observations; overlapping lines intersect).  Other states are";
+  msg += "\nskipped there by train, probability and decode, which then run on one thread; not with --beam,";
+  msg += "\n--top-k, --precision=int16 or an --engine other than standard.";
+  msg += "\n--engine picks the training algorithm: full keeps every trellis and makes one forward and one backward";
+  msg += "\nsweep, standard checkpoints backward results, mem also drops the statistics tables, split runs standard's";
+  msg += "\nforward and backward sweeps on two threads (same model up to rounding).  auto (default) picks the fastest";
+  msg += "\nof standard and mem, and of full under --mem-budget (bytes, or with a K, M or G suffix), whose estimated";
+  msg += "\npeak memory fits.  --plan prints the estimates and the choice, and exits without training.";
+  msg += "\n--trellis-dir keeps full's trellises in an unlinked temporary file under <dir> rather than in RAM.";
+  msg += "\n--fast-iterations uses a table-driven log-add (abs error < 1e-6) for the first <+integer> iterations.";
   return msg;
 }
 
-enum class Ops { TRAIN, PROB, DECODE, TRAIN_AND_DECODE };
+enum class Ops { TRAIN, PROB, DECODE, TRAIN_AND_DECODE, TRAIN_ONLINE, ESTEP, MSTEP, SERVE, PROFILE };
 
 std::vector<std::string> split(const std::string& s, const std::string& d) {
   std::vector<std::string> rtn;
@@ -104,34 +161,85 @@ std::vector<std::string> split(const std::string& s, const std::string& d) {
   return rtn;
 }
 
+// one model loaded by serve
+struct Served {
+  std::string _name; // parameters file, as given
+  std::vector<T> _initial, _linear; // log for probability, linear for decode
+  std::vector<std::vector<T>> _transition, _emission;
+  std::map<std::string, std::size_t> _mapID;
+};
+
 struct Input {
   Input(int argc, char** argv);
 
   int _niters;
+  int _nfast;
   int _nstates;
   int _nsymbols;
+  int _blocksize;
   bool _verbose;
   bool _read_params;
   int _seed;
+  ci::hmm::DecodeWriter::Format _format;
+  std::string _chrom;
+  std::size_t _nthreads;
+  bool _split; // --threads given: a single long sequence is split in time
+  ci::hmm::Engine _engine;
+  std::size_t _budget; // bytes; 0 is no limit
+  bool _plan;
+  std::string _trellisdir; // file-backed train_full() trellises; empty is RAM
+  ci::hmm::Beam<T> _beam;
+  bool _int16; // decode with quantized scores
   std::string _src;
   std::string _params;
+  std::vector<std::string> _stats;
   Ops _operation;
-  std::vector<T> _initial, _observed;
+  std::vector<T> _initial;
+  ci::hmm::PackedSequence<T> _observed; // 2 to 32 bits per symbol, widened as new symbols appear
+  std::vector<std::pair<std::string, std::size_t>> _records; // name and first position in _observed
+  bool _headers;
   std::vector<std::vector<T>> _transition, _emission;
   std::map<std::string, std::size_t> _mapID;
+  std::string _socket; // serve on a Unix socket rather than stdin
+  std::string _maskfile; // allowed states by position; empty is none
+  ci::hmm::StateMask _mask;
+  std::vector<Served> _served;
   static constexpr int _MAXITER = 1000000; // can be bigger; likely an error if you exceeded this though
   static constexpr int _MAXSTATES = 10000; // can be bigger; likely an error if you exceeded this though
 
+  bool read_block(std::istream& is);
+
 private:
+  void decode_option(const std::string& next);
+  void train_option(const std::string& next);
   void read_data();
   void read_parameters();
+  void read_mask();
   void initialize_parameters();
 };
 
 void output(const Input& input);
 
+void report_beam(const ci::hmm::BeamStats& stats, std::size_t nstates);
+
+void do_decode(const Input& input, const std::vector<T>& initial);
+
+void do_masked(const Input& input, const std::vector<T>& initial);
+
+ci::hmm::Engine plan_training(const Input& input);
+
 void do_work(Input& input);
 
+void do_online(Input& input);
+
+void do_estep(Input& input);
+
+void do_mstep(Input& input);
+
+void do_serve(Input& input);
+
+void do_profile(const Input& input);
+
 int main(int argc, char** argv) {
   try {
     Input input(argc, argv);
@@ -159,26 +267,98 @@ int main(int argc, char** argv) {
   return EXIT_FAILURE;
 }
 
+ci::hmm::Engine plan_training(const Input& input) {
+  // --engine=auto picks the fastest engine whose estimate fits --mem-budget
+  const std::size_t nobs = input._observed.size(), nstates = input._initial.size();
+  const std::size_t nsymbols = input._emission[0].size();
+  const bool mapped = !input._trellisdir.empty();
+  ci::hmm::Engine engine = input._engine;
+  if ( engine == ci::hmm::Engine::AUTO )
+    engine = ci::hmm::choose_engine<T>(nobs, nstates, nsymbols, input._budget, mapped).engine;
+
+  if ( input._plan ) {
+    std::cout << "# engine\testimated-bytes\trecursions-per-iteration" << std::endl;
+    for ( auto e : { ci::hmm::Engine::STANDARD, ci::hmm::Engine::MEM, ci::hmm::Engine::FULL, ci::hmm::Engine::SPLIT } ) {
+      const ci::hmm::EnginePlan p = ci::hmm::plan_engine<T>(e, nobs, nstates, nsymbols, mapped);
+      std::cout << ci::hmm::engine_name(e) << "\t" << p.bytes << "\t" << p.recursions;
+      if ( input._budget && p.bytes > input._budget )
+        std::cout << "\t(over budget)";
+      std::cout << std::endl;
+    } // for
+    std::cout << "# chosen\t" << ci::hmm::engine_name(engine) << std::endl;
+    return engine;
+  }
+
+  const std::size_t need = ci::hmm::plan_engine<T>(engine, nobs, nstates, nsymbols, mapped).bytes;
+  if ( input._budget && need > input._budget )
+    throw("Estimated memory for --engine=" + ci::hmm::engine_name(engine) + " (" + std::to_string(need) +
+          " bytes) exceeds --mem-budget.  See --plan");
+  return engine;
+}
+
 void do_work(Input& input) {
+  if ( input._operation == Ops::TRAIN_ONLINE ) {
+    do_online(input);
+    return;
+  } else if ( input._operation == Ops::ESTEP ) {
+    do_estep(input);
+    return;
+  } else if ( input._operation == Ops::MSTEP ) {
+    do_mstep(input);
+    return;
+  } else if ( input._operation == Ops::SERVE ) {
+    do_serve(input);
+    return;
+  } else if ( input._operation == Ops::PROFILE ) {
+    do_profile(input);
+    return;
+  }
+
   if ( input._operation == Ops::TRAIN || input._operation == Ops::TRAIN_AND_DECODE ) {
+    const ci::hmm::Engine engine = plan_training(input);
+    if ( input._plan )
+      return;
+
     auto last_trans = input._transition;
     auto last_emiss = input._emission;
     double log_likelihood = 0;
+    ci::hmm::Workspace<T> ws(input._initial.size(), input._emission[0].size()); // reused by every iteration
+    if ( !input._trellisdir.empty() )
+      ws.Backing(input._trellisdir, 0);
+    ci::hmm::PackedSequence<T> masked; // with --mask: symbols rewritten per allowed-state set
+    if ( !input._maskfile.empty() )
+      ci::hmm::mask_sequence(input._observed, input._mask, input._emission[0].size(), masked);
+    auto iterate = [&](auto policy) {
+      if ( !input._maskfile.empty() )
+        ci::hmm::train_masked(masked, input._mask, input._initial, input._transition, input._emission, ws, policy);
+      else if ( engine == ci::hmm::Engine::FULL )
+        ci::hmm::train_full(input._observed, input._initial, input._transition, input._emission, ws, policy);
+      else if ( engine == ci::hmm::Engine::MEM )
+        ci::hmm::train_mem(input._observed, input._initial, input._transition, input._emission, policy);
+      else if ( engine == ci::hmm::Engine::SPLIT )
+        ci::hmm::train_split(input._observed, input._initial, input._transition, input._emission, ws, policy);
+      else
+        ci::hmm::train_auto(input._observed, input._initial, input._transition, input._emission, ws, policy);
+    };
+
     for ( int i = 0; i < input._niters; ++i ) {
-      ci::hmm::train(input._observed, input._initial, input._transition, input._emission);
+      if ( i < input._nfast )
+        iterate(ci::hmm::fast_policy());
+      else
+        iterate(ci::hmm::exact_policy());
       if ( input._emission == last_emiss ) {
         if ( input._transition == last_trans )
           break;
+      } else if ( !input._maskfile.empty() ) {
+        ci::hmm::mask_emission(input._emission, input._mask, ws.masked);
+        log_likelihood = ci::hmm::evalp(masked, input._initial, input._transition, ws.masked, ws);
       } else {
-        log_likelihood = ci::hmm::evalp(input._observed, input._initial, input._transition, input._emission);
+        log_likelihood = ci::hmm::evalp_auto(input._observed, input._initial, input._transition, input._emission, ws);
       }
 
       if ( input._verbose ) {
         std::cout << "# iteration " << i+1 << std::endl;
         std::cout << "# log-likelihood " << log_likelihood << std::endl;
-        std::cout << "# ";
-        std::copy(input._observed.begin(), input._observed.end(), std::ostream_iterator<U>(std::cout, " "));
-        std::cout << std::endl;
       }
       last_trans = input._transition;
       last_emiss = input._emission;
@@ -187,8 +367,228 @@ void do_work(Input& input) {
   output(input);
 }
 
+void do_online(Input& input) {
+  std::ifstream file;
+  std::istream* is = &std::cin;
+  if ( input._src != "-" ) {
+    file.open(input._src.c_str());
+    is = &file;
+  }
+
+  if ( !input.read_block(*is) )
+    throw("Didn't find any data");
+
+  ci::hmm::OnlineEM<std::vector<T>, std::vector<std::vector<T>>, std::vector<std::vector<T>>> em(input._initial, input._transition, input._emission);
+  do {
+    const double log_likelihood = em.Update(input._observed);
+    if ( input._verbose ) {
+      std::cout << "# block " << em.Blocks() << std::endl;
+      std::cout << "# log-likelihood " << log_likelihood << std::endl;
+    }
+  } while ( input.read_block(*is) );
+  em.Finish();
+  output(input);
+}
+
+// one record of Input::_observed, without a copy
+typedef ci::hmm::PackedSequence<T>::Slice Record;
+
+void do_estep(Input& input) {
+  // records are independent sequences; per-record work is reduced in a fixed order (reduce.hpp)
+  std::vector<Record> records;
+  for ( std::size_t r = 0; r < input._records.size(); ++r ) {
+    const std::size_t end = (r+1 < input._records.size()) ? input._records[r+1].second : input._observed.size();
+    records.push_back(input._observed.Sub(input._records[r].second, end - input._records[r].second));
+  } // for
+  ci::hmm::Statistics<T> stats(input._initial.size(), input._emission[0].size());
+  ci::hmm::estep_records(records, input._initial, input._transition, input._emission, stats, input._nthreads);
+  ci::hmm::write_statistics(std::cout, stats);
+}
+
+void do_mstep(Input& input) {
+  ci::hmm::Statistics<T> stats(input._initial.size(), input._emission[0].size()), shard;
+  for ( auto& file : input._stats ) {
+    std::ifstream is(file.c_str(), std::ios::binary);
+    if ( !is )
+      throw("Input file not found: " + file);
+    ci::hmm::read_statistics(is, shard, file);
+    if ( shard.NStates() != stats.NStates() || shard.NSymbols() != stats.NSymbols() )
+      throw("Statistics file does not match " + input._params + ": " + file);
+    stats.Merge(shard);
+  } // for
+  if ( 0 == stats.nsequences )
+    throw("No observations found in statistics files");
+
+  ci::hmm::mstep(stats, input._initial, input._transition, input._emission);
+  std::cout << "# log-likelihood " << stats.loglik << std::endl;
+  output(input);
+}
+
+ci::hmm::Server* serving = nullptr; // for the signal handler
+
+extern "C" void stop_serving(int) {
+  if ( serving )
+    serving->Stop();
+}
+
+void do_serve(Input& input) {
+  enum { DECODE, PROB, NOPS };
+  ci::hmm::LatencyHistogram latency[NOPS];
+  const std::string opname[NOPS] = { "decode", "probability" };
+
+  struct Scratch { // one per worker
+    ci::hmm::Workspace<T> ws;
+    ci::hmm::PackedSequence<T> observed;
+    std::vector<std::size_t> states;
+  };
+  std::vector<Scratch> scratch(input._nthreads);
+
+  auto handle = [&](std::size_t w, const std::string& request) -> std::string {
+    const auto start = std::chrono::steady_clock::now();
+    const auto fields = split(request, "\t");
+    const std::string& id = fields[0];
+    if ( fields.size() == 2 && fields[1] == "stats" ) {
+      std::ostringstream os;
+      os << id;
+      for ( int op = 0; op < NOPS; ++op ) {
+        os << "\t" << opname[op] << " n=" << latency[op].Count() << " p50<=" << latency[op].Quantile(0.5)
+           << "us p90<=" << latency[op].Quantile(0.9) << "us p99<=" << latency[op].Quantile(0.99) << "us";
+      } // for
+      return(os.str());
+    }
+    const int op = (fields.size() < 2) ? NOPS : (fields[1] == opname[DECODE]) ? DECODE : (fields[1] == opname[PROB]) ? PROB : NOPS;
+    if ( op == NOPS || fields.size() != 4 )
+      return(id + "\terror\texpect <id> decode|probability <model> <observations>, or <id> stats");
+
+    const Served* m = nullptr;
+    for ( std::size_t i = 0; i < input._served.size() && !m; ++i ) {
+      if ( input._served[i]._name == fields[2] || std::to_string(i) == fields[2] )
+        m = &input._served[i];
+    } // for
+    if ( !m )
+      return(id + "\terror\tunknown model: " + fields[2]);
+
+    // labels not in the model map to its first, as with read_data()
+    Scratch& sc = scratch[w];
+    sc.observed.clear();
+    std::istringstream is(fields[3]);
+    std::string label;
+    while ( is >> label ) {
+      auto iter = m->_mapID.find(label);
+      sc.observed.push_back(iter != m->_mapID.end() ? iter->second : m->_mapID.begin()->second);
+    } // while
+
+    std::string response = id + "\t";
+    if ( op == DECODE ) {
+      sc.states.clear();
+      if ( !sc.observed.empty() )
+        ci::hmm::viterbi_auto(sc.observed, m->_linear, m->_transition, m->_emission, std::back_inserter(sc.states), sc.ws);
+      for ( std::size_t i = 0; i < sc.states.size(); ++i ) {
+        if ( i )
+          response += ' ';
+        response += std::to_string(sc.states[i]);
+      } // for
+    } else { // natural log, as for records; evalp() would underflow
+      const T logprob = ci::hmm::log_evalp(sc.observed, m->_initial, m->_transition, m->_emission, sc.ws);
+      std::ostringstream os;
+      if ( logprob == ci::inf<T>() )
+        os << "-inf";
+      else
+        os << logprob;
+      response += os.str();
+    }
+    latency[op].Record(std::chrono::steady_clock::now() - start);
+    return(response);
+  };
+
+  {
+    typedef ci::hmm::Server S;
+    auto overlong = [](const std::string& head) -> std::string {
+      return(head.substr(0, head.find('\t')) + "\terror\trequest longer than " + std::to_string(S::MaxLine) + " bytes");
+    };
+    S server(handle, input._nthreads, S::MaxLine, overlong);
+    if ( input._socket.empty() ) {
+      server.Serve(0, 1);
+    } else {
+      serving = &server;
+      std::signal(SIGINT, stop_serving);
+      std::signal(SIGTERM, stop_serving);
+      server.Listen(input._socket);
+      serving = nullptr;
+    }
+  }
+
+  std::cerr << "# operation\tfrom-us\tto-us\tcount" << std::endl;
+  for ( int op = 0; op < NOPS; ++op )
+    latency[op].Write(std::cerr, opname[op]);
+}
+
+void do_profile(const Input& input) {
+  // each phase runs alone, so its counters are its own; estep covers gamma and xi accumulation
+  //  on top of its own forward and BackCache<> work
+  const std::size_t nobs = input._observed.size(), nstates = input._initial.size();
+  if ( nobs < 2 )
+    throw("profile needs at least 2 observations");
+  ci::hmm::Workspace<T> ws;
+  std::vector<T> alpha(nstates), beta(nstates), linear(input._initial);
+  std::vector<std::size_t> states;
+  do_exp(linear);
+  typedef std::pair<std::string, std::function<void()>> Phase;
+  const std::vector<Phase> phases = {
+    Phase("forward", [&]() {
+      ci::hmm::forward_index(input._observed, input._initial, input._transition, input._emission, nobs, alpha, ws);
+    }),
+    Phase("backward", [&]() {
+      ci::hmm::backward_index(input._observed, input._initial, input._transition, input._emission, 1, beta, ws);
+    }),
+    Phase("backcache", [&]() {
+      ci::hmm::details::BackCache<ci::hmm::PackedSequence<T>, std::vector<T>, std::vector<std::vector<T>>, std::vector<std::vector<T>>, T>
+                        cache(input._observed, input._initial, input._transition, input._emission, ci::hmm::exact_logsum(), &ws);
+      for ( std::vector<T> const* b = cache.Next(); b; b = cache.Next() )
+        cache.Release(b);
+    }),
+    Phase("estep", [&]() {
+      ci::hmm::Statistics<T> stats(nstates, input._emission[0].size());
+      ci::hmm::estep_auto(input._observed, input._initial, input._transition, input._emission, stats, ws);
+    }),
+    Phase("viterbi", [&]() {
+      states.clear();
+      ci::hmm::viterbi_auto(input._observed, linear, input._transition, input._emission, std::back_inserter(states), ws);
+    })
+  };
+
+  ci::hmm::PerfCounters counters;
+  if ( !counters.Unavailable().empty() )
+    std::cerr << "# profile: some hardware counters are unavailable (" << counters.Unavailable() << ")" << std::endl;
+  const double cells = static_cast<double>(nobs) * nstates; // symbol-states
+  typedef ci::hmm::PerfCounters PC;
+  std::cout << "# observations " << nobs << "\tstates " << nstates << "\tsymbols " << input._emission[0].size() << std::endl;
+  std::cout << "# phase\tseconds\tns/symbol-state\tcycles\tinstructions\tIPC\tcache-misses\tbranch-misses";
+  std::cout << "\tcache-misses/symbol-state\tbranch-misses/symbol-state" << std::endl;
+  for ( auto& p : phases ) {
+    counters.Start();
+    p.second();
+    const PC::Sample s = counters.Stop();
+    auto count = [&](PC::Event e) { return(s.Valid(e) ? std::to_string(s.count[e]) : std::string("n/a")); };
+    auto ratio = [&](bool ok, double n, double d) {
+      std::ostringstream os;
+      if ( ok && d > 0 )
+        os << n / d;
+      else
+        os << "n/a";
+      return(os.str());
+    };
+    std::cout << p.first << "\t" << s.seconds << "\t" << s.seconds * 1e9 / cells;
+    std::cout << "\t" << count(PC::CYCLES) << "\t" << count(PC::INSTRUCTIONS);
+    std::cout << "\t" << ratio(s.Valid(PC::CYCLES) && s.Valid(PC::INSTRUCTIONS), s.count[PC::INSTRUCTIONS], s.count[PC::CYCLES]);
+    std::cout << "\t" << count(PC::CACHE_MISSES) << "\t" << count(PC::BRANCH_MISSES);
+    std::cout << "\t" << ratio(s.Valid(PC::CACHE_MISSES), s.count[PC::CACHE_MISSES], cells);
+    std::cout << "\t" << ratio(s.Valid(PC::BRANCH_MISSES), s.count[PC::BRANCH_MISSES], cells) << std::endl;
+  } // for
+}
+
 void output(const Input& input) {
-  if ( input._operation == Ops::TRAIN ) {
+  if ( input._operation == Ops::TRAIN || input._operation == Ops::TRAIN_ONLINE || input._operation == Ops::MSTEP ) {
     std::cout << nstate_header << " " << input._nstates << std::endl;
     std::cout << nsymbol_header << " " << input._nsymbols << std::endl;
 
@@ -235,21 +635,234 @@ void output(const Input& input) {
       std::cout << std::endl;
     } // for
     std::cout << "}" << std::endl;
+  } else if ( input._operation == Ops::PROB && !input._maskfile.empty() ) {
+    do_masked(input, input._initial);
+  } else if ( input._operation == Ops::PROB && input._headers ) { // one line per record, many records at a time
+    std::vector<Record> records;
+    for ( std::size_t r = 0; r < input._records.size(); ++r ) {
+      const std::size_t end = (r+1 < input._records.size()) ? input._records[r+1].second : input._observed.size();
+      records.push_back(input._observed.Sub(input._records[r].second, end - input._records[r].second));
+    } // for
+    std::vector<float> logprobs;
+    if ( input._beam.Active() ) {
+      ci::hmm::Workspace<T> ws;
+      ci::hmm::BeamStats stats;
+      std::vector<T> alpha(input._initial.size());
+      logprobs.assign(records.size(), ci::inf<float>());
+      for ( std::size_t r = 0; r < records.size(); ++r ) {
+        if ( records[r].size() < 2 )
+          continue;
+        ci::hmm::forward_beam(records[r], input._initial, input._transition, input._emission, records[r].size(), alpha, input._beam, stats, ws);
+        for ( std::size_t i = 0; i < alpha.size(); ++i )
+          logprobs[r] = ci::hmm::elnsum(logprobs[r], alpha[i]);
+      } // for
+      report_beam(stats, input._initial.size());
+    } else {
+      ci::hmm::evalp_batch(records, input._initial, input._transition, input._emission, logprobs);
+    }
+    for ( std::size_t r = 0; r < records.size(); ++r ) {
+      std::cout << input._records[r].first << "\t";
+      if ( logprobs[r] == ci::inf<float>() )
+        std::cout << "-inf\n";
+      else
+        std::cout << logprobs[r] << "\n";
+    } // for
+    std::cout.flush();
+  } else if ( input._operation == Ops::PROB && input._beam.Active() ) {
+    ci::hmm::Workspace<T> ws;
+    ci::hmm::BeamStats stats;
+    std::cout << ci::hmm::evalp_beam(input._observed, input._initial, input._transition, input._emission, input._beam, stats, ws) << std::endl;
+    report_beam(stats, input._initial.size());
+  } else if ( input._operation == Ops::PROB && input._split && input._nthreads > 1 ) { // one long sequence, split in time
+    std::cout << ci::hmm::evalp_scan(input._observed, input._initial, input._transition, input._emission, input._nthreads) << std::endl;
   } else if ( input._operation == Ops::PROB ) {
-    std::cout << ci::hmm::evalp(input._observed, input._initial, input._transition, input._emission) << std::endl;
-  } else if ( input._operation == Ops::DECODE ) { \
+    ci::hmm::Workspace<T> ws;
+    std::cout << ci::hmm::evalp_auto(input._observed, input._initial, input._transition, input._emission, ws) << std::endl;
+  } else { // Ops::DECODE or Ops::TRAIN_AND_DECODE
     auto initial_cpy = input._initial;
-    do_exp(initial_cpy);
-    std::ostream_iterator<U> os(std::cout, " ");
-    ci::hmm::viterbi(input._observed, initial_cpy, input._transition, input._emission, os);
-    std::cout << std::endl;
-  } else { // Ops::TRAIN_AND_DECODE
-    std::ostream_iterator<U> os(std::cout, " ");
-    ci::hmm::viterbi(input._observed, input._initial, input._transition, input._emission, os);
-    std::cout << std::endl;
+    if ( input._operation == Ops::DECODE )
+      do_exp(initial_cpy);
+    std::cout.flush();
+    if ( !input._maskfile.empty() )
+      do_masked(input, initial_cpy);
+    else
+      do_decode(input, initial_cpy);
   }
 }
 
+void report_beam(const ci::hmm::BeamStats& stats, std::size_t nstates) {
+  std::cerr << "# beam: dropped mass " << stats.dropped << " over " << stats.columns << " steps; mean active states ";
+  std::cerr << (stats.columns ? static_cast<double>(stats.active) / stats.columns : 0.0) << " of " << nstates << std::endl;
+}
+
+void do_decode(const Input& input, const std::vector<T>& initial) {
+  // workers decode records into a ring of reorder slots; this thread formats them in input order
+  const std::size_t nrecords = input._records.size();
+  const std::size_t nthreads = std::max<std::size_t>(1, std::min(input._nthreads, nrecords));
+  static constexpr std::size_t lanes = 8; // records up to short_record long are decoded lanes at a time
+  static constexpr std::size_t short_record = 1 << 16;
+  const std::size_t window = 4 * nthreads * lanes; // max records decoded ahead of output
+  std::vector<std::vector<U>> slots(window);
+  std::vector<bool> ready(window, false);
+  std::size_t claimed = 0, written = 0;
+  std::mutex mtx;
+  std::condition_variable cv;
+  ci::hmm::BeamStats beamstats; // summed over workers
+  ci::hmm::QuantizedModel quant; // shared read-only; Valid() only with --precision=int16
+  if ( input._int16 && !input._beam.Active() ) {
+    quant = ci::hmm::QuantizedModel(initial, input._transition, input._emission);
+    if ( !quant.Valid() )
+      std::cerr << "# precision: model has log-zero scores; decoding in float" << std::endl;
+  }
+
+  auto length = [&](std::size_t r) {
+    const std::size_t end = (r+1 < nrecords) ? input._records[r+1].second : input._observed.size();
+    return end - input._records[r].second;
+  };
+
+  if ( nrecords == 1 && input._split && input._nthreads > 1 && length(0) > short_record && !input._beam.Active() && !quant.Valid() ) { // one long sequence, split in time
+    ci::hmm::AsyncWriter writer(std::cout);
+    if ( input._headers && input._format != ci::hmm::DecodeWriter::Format::BED )
+      writer.Write(">" + input._records[0].first + "\n");
+    ci::hmm::DecodeWriter decoded(writer, input._format, input._records[0].first);
+    ci::hmm::viterbi_scan(input._observed, initial, input._transition, input._emission,
+                          ci::hmm::decode_iterator(decoded), input._nthreads);
+    decoded.Finish();
+    return;
+  }
+
+  auto worker = [&]() {
+    ci::hmm::Workspace<T> ws(initial.size(), 0); // per-thread scratch; the model is shared read-only
+    std::vector<Record> batch;
+    std::vector<std::vector<U>> paths;
+    ci::hmm::BeamStats stats;
+    while ( true ) {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [&] { return claimed == nrecords || claimed < written + window; });
+      if ( claimed == nrecords ) {
+        beamstats.dropped += stats.dropped, beamstats.active += stats.active, beamstats.columns += stats.columns;
+        return;
+      }
+      const std::size_t r = claimed;
+      std::size_t last = r + 1; // claim [r, last): one long record or up to 'lanes' short ones
+      if ( length(r) <= short_record && !input._beam.Active() && !quant.Valid() ) {
+        while ( last < nrecords && last - r < lanes && last < written + window && length(last) <= short_record )
+          ++last;
+      }
+      claimed = last;
+      lock.unlock();
+
+      // slots in [r, last) are owned by this thread until marked ready
+      if ( last - r == 1 ) {
+        std::vector<U>& states = slots[r % window];
+        states.clear();
+        if ( length(r) > 0 && input._beam.Active() )
+          ci::hmm::viterbi_beam(input._observed.Sub(input._records[r].second, length(r)),
+                                initial, input._transition, input._emission, std::back_inserter(states), input._beam, stats, ws);
+        else if ( length(r) > 0 && quant.Valid() )
+          ci::hmm::viterbi_quantized(input._observed.Sub(input._records[r].second, length(r)), quant, std::back_inserter(states), ws);
+        else if ( length(r) > 0 )
+          ci::hmm::viterbi_auto(input._observed.Sub(input._records[r].second, length(r)),
+                                initial, input._transition, input._emission, std::back_inserter(states), ws);
+      } else {
+        batch.clear();
+        for ( std::size_t q = r; q < last; ++q )
+          batch.push_back(input._observed.Sub(input._records[q].second, length(q)));
+        ci::hmm::viterbi_batch<lanes>(batch, initial, input._transition, input._emission, paths);
+        for ( std::size_t q = r; q < last; ++q )
+          slots[q % window].swap(paths[q - r]);
+      }
+
+      lock.lock();
+      for ( std::size_t q = r; q < last; ++q )
+        ready[q % window] = true;
+      cv.notify_all();
+    } // while
+  };
+
+  std::vector<std::thread> pool;
+  for ( std::size_t i = 0; i < nthreads; ++i )
+    pool.push_back(std::thread(worker));
+
+  {
+    ci::hmm::AsyncWriter writer(std::cout); // formatting and writing overlap with decoding
+    std::vector<U> states;
+    for ( std::size_t r = 0; r < nrecords; ++r ) {
+      {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&] { return ready[r % window]; });
+        states.swap(slots[r % window]);
+        ready[r % window] = false;
+        ++written;
+      }
+      cv.notify_all();
+
+      if ( input._headers && input._format != ci::hmm::DecodeWriter::Format::BED )
+        writer.Write(">" + input._records[r].first + "\n");
+      ci::hmm::DecodeWriter decoded(writer, input._format, input._records[r].first);
+      std::copy(states.begin(), states.end(), ci::hmm::decode_iterator(decoded));
+      decoded.Finish();
+    } // for
+  }
+
+  for ( auto& t : pool )
+    t.join();
+  if ( input._beam.Active() )
+    report_beam(beamstats, initial.size());
+}
+
+void do_masked(const Input& input, const std::vector<T>& initial) {
+  // probability or decode under --mask, one record after another on this thread; the generic kernels
+  //  skip the states each position's mask leaves out (include/impl/mask.hpp)
+  const std::size_t nrecords = input._records.size();
+  ci::hmm::Workspace<T> ws(initial.size(), 0);
+  ci::hmm::PackedSequence<T> masked;
+  std::vector<std::vector<T>> emission;
+  ci::hmm::mask_sequence(input._observed, input._mask, input._emission[0].size(), masked);
+  ci::hmm::mask_emission(input._emission, input._mask, emission);
+  std::cerr << "# mask: mean allowed states " << static_cast<double>(input._mask.Allowed()) / std::max<std::size_t>(1, masked.size());
+  std::cerr << " of " << initial.size() << std::endl;
+
+  auto length = [&](std::size_t r) {
+    const std::size_t end = (r+1 < nrecords) ? input._records[r+1].second : input._observed.size();
+    return end - input._records[r].second;
+  };
+
+  if ( input._operation == Ops::PROB && !input._headers ) {
+    std::cout << ci::hmm::evalp(masked, initial, input._transition, emission, ws) << std::endl;
+    return;
+  } else if ( input._operation == Ops::PROB ) { // natural log per record, as without --mask
+    std::vector<T> alpha(initial.size());
+    for ( std::size_t r = 0; r < nrecords; ++r ) {
+      T logprob = ci::inf<T>();
+      if ( length(r) >= 2 ) {
+        ci::hmm::forward_index(masked.Sub(input._records[r].second, length(r)), initial, input._transition, emission, length(r), alpha, ws);
+        for ( std::size_t i = 0; i < alpha.size(); ++i )
+          logprob = ci::hmm::elnsum(logprob, alpha[i]);
+      }
+      std::cout << input._records[r].first << "\t";
+      if ( logprob == ci::inf<T>() )
+        std::cout << "-inf\n";
+      else
+        std::cout << logprob << "\n";
+    } // for
+    std::cout.flush();
+    return;
+  }
+
+  ci::hmm::AsyncWriter writer(std::cout);
+  std::vector<U> states;
+  for ( std::size_t r = 0; r < nrecords; ++r ) {
+    states.clear();
+    if ( length(r) > 0 )
+      ci::hmm::viterbi(masked.Sub(input._records[r].second, length(r)), initial, input._transition, emission, std::back_inserter(states), ws);
+    if ( input._headers && input._format != ci::hmm::DecodeWriter::Format::BED )
+      writer.Write(">" + input._records[r].first + "\n");
+    ci::hmm::DecodeWriter decoded(writer, input._format, input._records[r].first);
+    std::copy(states.begin(), states.end(), ci::hmm::decode_iterator(decoded));
+    decoded.Finish();
+  } // for
+}
 
 struct ByLine : public std::string {
   friend std::istream& operator>>(std::istream& is, ByLine& b) {
@@ -258,9 +871,11 @@ struct ByLine : public std::string {
   }
 };
 
-Input::Input(int argc, char** argv) : _niters(1), _nstates(1), _nsymbols(0),
+Input::Input(int argc, char** argv) : _niters(1), _nfast(0), _nstates(1), _nsymbols(0), _blocksize(10000),
                                       _verbose(false), _read_params(false),
-                                      _seed(std::time(NULL)) {
+                                      _seed(std::time(NULL)), _format(ci::hmm::DecodeWriter::Format::STATES),
+                                      _nthreads(std::max(1u, std::thread::hardware_concurrency())), _split(false),
+                                      _engine(ci::hmm::Engine::AUTO), _budget(0), _plan(false), _int16(false), _headers(false) {
   for ( int i = 1; i < argc; ++i ) {
     if ( std::string(argv[i]) == "--help" )
       throw(Help());
@@ -270,7 +885,7 @@ Input::Input(int argc, char** argv) : _niters(1), _nstates(1), _nsymbols(0),
 
   if ( argc == 1 )
     throw(NoInput());
-  if ( argc < 4 )
+  if ( argc < 4 && !(argc == 3 && std::string(argv[1]) == "serve") )
     throw("Wrong number of args: see --help");
 
   const std::string ints = "0123456789";
@@ -278,7 +893,7 @@ Input::Input(int argc, char** argv) : _niters(1), _nstates(1), _nsymbols(0),
   const std::string todo = argv[nextc++];
   std::string next = argv[nextc++];
   if ( todo == "train" || todo == "train-and-decode" ) {
-    if ( (argc < 5) || (argc > 7) )
+    if ( (argc < 5) || (argc > 16) )
       throw("Wrong number of args for '" + todo + ".  See --help");
     _operation = Ops::TRAIN;
     if ( todo == "train-and-decode" )
@@ -289,6 +904,21 @@ Input::Input(int argc, char** argv) : _niters(1), _nstates(1), _nsymbols(0),
         break;
       if ( next == "--verbose" ) {
         _verbose = true;
+      } else if ( next.find("--fast-iterations") == 0 ) {
+        auto v = split(next, "=");
+        if ( v.size() != 2 || v[1].empty() || v[1].find_first_not_of(ints) != std::string::npos )
+          throw("Bad number.  Expect a +integer for " + next + ".  See --help");
+        _nfast = std::atoi(v[1].c_str());
+      } else if ( next == "--plan" ) {
+        _plan = true;
+      } else if ( next.find("--engine") == 0 || next.find("--mem-budget") == 0 || next.find("--trellis-dir") == 0 ) {
+        train_option(next);
+      } else if ( next.find("--format") == 0 || next.find("--chrom") == 0 || next.find("--threads") == 0 ) {
+        if ( todo != "train-and-decode" )
+          throw("Unknown option for '" + todo + "': " + next + ".  See --help");
+        decode_option(next);
+      } else if ( next.find("--mask") == 0 ) {
+        decode_option(next);
       } else {
         auto v = split(next, "=");
         if ( v.size() != 2 )
@@ -312,8 +942,65 @@ Input::Input(int argc, char** argv) : _niters(1), _nstates(1), _nsymbols(0),
     if ( next.find_first_not_of(ints) != std::string::npos )
       throw("Bad argument - expect a +integer for <number-iterations>.  See --help");
     _niters = std::atoi(next.c_str());
+  } else if ( todo == "train-online" ) {
+    _operation = Ops::TRAIN_ONLINE;
+    while ( next.find("--") == 0 && nextc < argc ) {
+      if ( next == "--verbose" ) {
+        _verbose = true;
+      } else {
+        auto v = split(next, "=");
+        if ( v.size() != 2 || v[1].empty() || v[1].find_first_not_of(ints) != std::string::npos )
+          throw("Bad number.  Expect a +integer for " + next + ".  See --help");
+        if ( v[0] == "--seed" ) {
+          _seed = std::atoi(v[1].c_str());
+          std::srand(_seed);
+        } else if ( v[0] == "--block-size" ) {
+          _blocksize = std::atoi(v[1].c_str());
+          if ( _blocksize <= 0 )
+            throw("Bad number.  Expect a +integer for " + next + ".  See --help");
+        } else {
+          throw("Unknown option for '" + todo + "': " + next + ".  See --help");
+        }
+      }
+      next = argv[nextc++];
+    } // while
+    if ( nextc != argc - 1 )
+      throw("Wrong number (or order) of arguments for " + todo + ".  See --help");
+    if ( next.find_first_not_of(ints) != std::string::npos )
+      throw("Bad argument: expect a +integer for <number-states>.  See --help");
+    _nstates = std::atoi(next.c_str());
+  } else if ( todo == "estep" ) {
+    while ( next.find("--") == 0 && nextc < argc ) {
+      if ( next.find("--threads") != 0 )
+        throw("Unknown option for '" + todo + "': " + next + ".  See --help");
+      decode_option(next);
+      next = argv[nextc++];
+    } // while
+    if ( nextc != argc - 1 )
+      throw("Wrong number of args for '" + todo + ".  See --help");
+    _operation = Ops::ESTEP;
+    _params = next;
+    std::ifstream f(_params.c_str());
+    if (!f)
+      throw("Input file not found: " + _params);
+    read_parameters();
+  } else if ( todo == "mstep" ) {
+    _operation = Ops::MSTEP;
+    _params = next;
+    std::ifstream f(_params.c_str());
+    if (!f)
+      throw("Input file not found: " + _params);
+    read_parameters();
+    for ( ; nextc < argc; ++nextc )
+      _stats.push_back(argv[nextc]);
   } else if ( todo == "probability" ) {
-    if ( argc != 4 )
+    while ( next.find("--") == 0 && nextc < argc ) {
+      if ( next.find("--threads") != 0 && next.find("--beam") != 0 && next.find("--top-k") != 0 && next.find("--mask") != 0 )
+        throw("Unknown option for '" + todo + "': " + next + ".  See --help");
+      decode_option(next);
+      next = argv[nextc++];
+    } // while
+    if ( nextc != argc - 1 )
       throw("Wrong number of args for '" + todo + ".  See --help");
     _operation = Ops::PROB;
     _params = next;
@@ -322,7 +1009,11 @@ Input::Input(int argc, char** argv) : _niters(1), _nstates(1), _nsymbols(0),
       throw("Input file not found: " + _params);
     read_parameters();
   } else if ( todo == "decode" ) {
-    if ( argc != 4 )
+    while ( next.find("--") == 0 && nextc < argc ) {
+      decode_option(next);
+      next = argv[nextc++];
+    } // while
+    if ( nextc != argc - 1 )
       throw("Wrong number of args for '" + todo + ".  See --help");
     _operation = Ops::DECODE;
     _params = next;
@@ -330,6 +1021,48 @@ Input::Input(int argc, char** argv) : _niters(1), _nstates(1), _nsymbols(0),
     if (!f)
       throw("Input file not found: " + _params);
     read_parameters();
+  } else if ( todo == "profile" ) {
+    if ( argc != 4 )
+      throw("Wrong number of args for '" + todo + ".  See --help");
+    _operation = Ops::PROFILE;
+    _params = next;
+    std::ifstream f(_params.c_str());
+    if (!f)
+      throw("Input file not found: " + _params);
+    read_parameters();
+  } else if ( todo == "serve" ) {
+    while ( next.find("--") == 0 && nextc < argc ) {
+      if ( next.find("--socket") == 0 ) {
+        auto v = split(next, "=");
+        if ( v.size() != 2 || v[1].empty() )
+          throw("Expect a path for " + next + ".  See --help");
+        _socket = v[1];
+      } else if ( next.find("--threads") == 0 ) {
+        decode_option(next);
+      } else {
+        throw("Unknown option for '" + todo + "': " + next + ".  See --help");
+      }
+      next = argv[nextc++];
+    } // while
+    if ( next.find("--") == 0 )
+      throw("Wrong number of args for '" + todo + ".  See --help");
+    _operation = Ops::SERVE;
+    for ( --nextc; nextc < argc; ++nextc ) { // load each model once, up front
+      _params = argv[nextc];
+      std::ifstream f(_params.c_str());
+      if (!f)
+        throw("Input file not found: " + _params);
+      _initial.clear(), _transition.clear(), _emission.clear(), _mapID.clear();
+      _nsymbols = 0;
+      read_parameters();
+      Served m;
+      m._name = _params;
+      m._initial = m._linear = _initial;
+      do_exp(m._linear);
+      m._transition.swap(_transition), m._emission.swap(_emission), m._mapID.swap(_mapID);
+      _served.push_back(std::move(m));
+    } // for
+    return;
   } else {
     throw("Unknown operation: '" + todo + "'.  See --help.");
   }
@@ -339,7 +1072,18 @@ Input::Input(int argc, char** argv) : _niters(1), _nstates(1), _nsymbols(0),
   else if ( _nstates <= 0 || _nstates > _MAXSTATES )
     throw("Bad number of '" + todo + "' states");
 
+  if ( _operation == Ops::MSTEP )
+    return; // statistics files are read by do_mstep()
+
   _src = argv[nextc++];
+  if ( _chrom.empty() )
+    _chrom = _src;
+  if ( _operation == Ops::TRAIN_ONLINE ) {
+    if ( _src != "-" && !std::ifstream(_src.c_str()) )
+      throw("Input file not found: " + _src);
+    return; // observations are streamed by read_block()
+  }
+
   std::ifstream f(_src.c_str());
   if (!f)
     throw("Input file not found: " + _src);
@@ -351,6 +1095,93 @@ Input::Input(int argc, char** argv) : _niters(1), _nstates(1), _nsymbols(0),
     if ( _nsymbols == 0 )
       throw("Didn't find any data");
   }
+
+  if ( !_maskfile.empty() ) {
+    if ( _beam.Active() || _int16 )
+      throw(std::string("--mask cannot be used with --beam, --top-k or --precision=int16.  See --help"));
+    if ( _engine != ci::hmm::Engine::AUTO && _engine != ci::hmm::Engine::STANDARD )
+      throw(std::string("--mask trains with the standard engine only.  See --help"));
+    read_mask(); // only after the model and observations are known
+  }
+}
+
+void Input::decode_option(const std::string& next) {
+  auto v = split(next, "=");
+  if ( v.size() != 2 || v[1].empty() )
+    throw("Bad option: " + next + ".  See --help");
+  if ( v[0] == "--chrom" )
+    _chrom = v[1];
+  else if ( v[0] == "--beam" ) {
+    char* end = nullptr;
+    _beam.width = std::strtod(v[1].c_str(), &end);
+    if ( *end != '\0' || !(_beam.width >= 0) )
+      throw("Bad number.  Expect a non-negative real for " + next + ".  See --help");
+  } else if ( v[0] == "--top-k" ) {
+    if ( v[1].find_first_not_of("0123456789") != std::string::npos || std::atoi(v[1].c_str()) <= 0 )
+      throw("Bad number.  Expect a +integer for " + next + ".  See --help");
+    _beam.topk = std::atoi(v[1].c_str());
+  }
+  else if ( v[0] == "--mask" ) {
+    if ( !std::ifstream(v[1].c_str()) )
+      throw("Mask file not found: " + v[1]);
+    _maskfile = v[1];
+  }
+  else if ( v[0] == "--precision" ) {
+    if ( v[1] != "float" && v[1] != "int16" )
+      throw("Unknown --precision: " + v[1] + ".  See --help");
+    _int16 = (v[1] == "int16");
+  }
+  else if ( v[0] == "--threads" ) {
+    if ( v[1].find_first_not_of("0123456789") != std::string::npos || std::atoi(v[1].c_str()) <= 0 )
+      throw("Bad number.  Expect a +integer for " + next + ".  See --help");
+    _nthreads = std::atoi(v[1].c_str());
+    _split = true;
+  } else if ( v[0] != "--format" )
+    throw("Unknown option: " + next + ".  See --help");
+  else if ( v[1] == "states" )
+    _format = ci::hmm::DecodeWriter::Format::STATES;
+  else if ( v[1] == "segments" )
+    _format = ci::hmm::DecodeWriter::Format::SEGMENTS;
+  else if ( v[1] == "bed" )
+    _format = ci::hmm::DecodeWriter::Format::BED;
+  else
+    throw("Unknown --format: " + v[1] + ".  See --help");
+}
+
+void Input::train_option(const std::string& next) {
+  auto v = split(next, "=");
+  if ( v.size() != 2 || v[1].empty() )
+    throw("Bad option: " + next + ".  See --help");
+  if ( v[0] == "--engine" ) {
+    if ( v[1] == "auto" )
+      _engine = ci::hmm::Engine::AUTO;
+    else if ( v[1] == "full" )
+      _engine = ci::hmm::Engine::FULL;
+    else if ( v[1] == "standard" )
+      _engine = ci::hmm::Engine::STANDARD;
+    else if ( v[1] == "mem" )
+      _engine = ci::hmm::Engine::MEM;
+    else if ( v[1] == "split" )
+      _engine = ci::hmm::Engine::SPLIT;
+    else
+      throw("Unknown --engine: " + v[1] + ".  See --help");
+  } else if ( v[0] == "--mem-budget" ) { // bytes, with an optional K, M or G suffix
+    std::size_t scale = 1;
+    std::string digits = v[1];
+    const std::string suffixes = "KMG";
+    const std::size_t pos = suffixes.find(digits.back());
+    if ( pos != std::string::npos ) {
+      scale = std::size_t(1) << (10 * (pos + 1));
+      digits.pop_back();
+    }
+    if ( digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos || std::atoll(digits.c_str()) <= 0 )
+      throw("Bad number.  Expect a +integer with an optional K, M or G suffix for " + next + ".  See --help");
+    _budget = std::atoll(digits.c_str()) * scale;
+  } else if ( v[0] == "--trellis-dir" ) {
+    _trellisdir = v[1];
+  } else {
+    throw("Unknown option: " + next + ".  See --help");
+  }
 }
 
 void Input::read_data() {
@@ -361,9 +1192,24 @@ void Input::read_data() {
   if ( !_read_params )
     _mapID.clear();
   auto iter = _mapID.end();
+  _records.clear();
+  _headers = false;
 
   int counter = 0;
   while ( f>>s ) {
+    if ( s[0] == '>' ) { // record header: name is the first word
+      std::string rest;
+      std::getline(f, rest);
+      std::istringstream is(s.substr(1) + " " + rest);
+      std::string name;
+      is >> name;
+      if ( !_headers && !_observed.empty() )
+        _records.push_back(std::make_pair(_chrom, 0));
+      _records.push_back(std::make_pair(name, _observed.size()));
+      _headers = true;
+      continue;
+    }
+
     if ( (iter = _mapID.find(s)) != _mapID.end() )
       _observed.push_back(iter->second);
     else {
@@ -378,6 +1224,8 @@ void Input::read_data() {
         _observed.push_back(_mapID[s] = counter++);
     }
   } // while
+  if ( _records.empty() )
+    _records.push_back(std::make_pair(_chrom, 0));
   if ( _nsymbols == 0 )
     _nsymbols = _mapID.size();
   else {
@@ -386,6 +1234,68 @@ void Input::read_data() {
   }
 }
 
+bool Input::read_block(std::istream& is) {
+  std::string s;
+  _observed.clear();
+  auto iter = _mapID.end();
+  while ( _observed.size() < static_cast<std::size_t>(_blocksize) && is>>s ) {
+    if ( s[0] == '>' ) { // records are concatenated
+      std::getline(is, s);
+      continue;
+    }
+    if ( (iter = _mapID.find(s)) != _mapID.end() ) {
+      _observed.push_back(iter->second);
+      continue;
+    }
+
+    const std::size_t id = _mapID.size();
+    _observed.push_back(_mapID[s] = id);
+    if ( !_emission.empty() ) { // new symbol mid-stream: give it 1/(M+1) of each state's mass
+      const T eps = static_cast<T>(1) / (_emission[0].size() + 1);
+      for ( auto& row : _emission ) {
+        for ( auto& e : row )
+          e = ci::hmm::elnproduct(e, static_cast<T>(std::log(1 - eps)));
+        row.push_back(std::log(eps));
+      } // for
+    }
+  } // while
+  _nsymbols = _mapID.size();
+
+  if ( _emission.empty() && !_observed.empty() )
+    initialize_parameters(); // only after the first block due to _nsymbols
+  return(!_observed.empty());
+}
+
+void Input::read_mask() {
+  // <start> <end> <state>[,<state>...] per line; 0-based, half-open positions over all observations
+  const std::string ints = "0123456789";
+  const std::size_t nstates = _initial.size();
+  _mask.Reset(nstates, _observed.size());
+  std::ifstream f(_maskfile.c_str());
+  std::string line;
+  for ( std::size_t lineno = 1; std::getline(f, line); ++lineno ) {
+    std::istringstream is(line);
+    std::string start, end, states, extra;
+    if ( !(is >> start) || start[0] == '#' )
+      continue; // blank or comment
+    const std::string where = _maskfile + " line " + std::to_string(lineno) + ": " + line;
+    if ( !(is >> end >> states) || (is >> extra) )
+      throw("Bad mask: expect <start> <end> <state>[,<state>...] at " + where);
+    if ( start.find_first_not_of(ints) != std::string::npos || end.find_first_not_of(ints) != std::string::npos )
+      throw("Bad mask: expect +integer positions at " + where);
+    const std::size_t first = std::strtoull(start.c_str(), nullptr, 10), last = std::strtoull(end.c_str(), nullptr, 10);
+    if ( first >= last || last > _observed.size() )
+      throw("Bad mask: positions must satisfy start < end <= " + std::to_string(_observed.size()) + " at " + where);
+    std::vector<std::size_t> allowed;
+    for ( auto& state : split(states, ",") ) {
+      if ( state.empty() || state.find_first_not_of(ints) != std::string::npos || std::strtoull(state.c_str(), nullptr, 10) >= nstates )
+        throw("Bad mask: states must be 0-based integers under " + std::to_string(nstates) + " at " + where);
+      allowed.push_back(std::strtoull(state.c_str(), nullptr, 10));
+    } // for
+    _mask.Allow(first, last, allowed);
+  } // for
+}
+
 void Input::read_parameters() {
   const std::string ints = "0123456789";
   const std::string reals = ints + "e-+.";